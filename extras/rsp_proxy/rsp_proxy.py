@@ -0,0 +1,547 @@
+#!/usr/bin/env python3
+
+#	Copyright (C) 2026 Mikael Hildenborg
+#	SPDX-License-Identifier: MIT
+
+"""
+Proxy between gdb and gdbsrv.ttp that saves round trips on the slow serial link.
+
+gdb connects to the proxy with TCP or a pty, and the proxy talks to gdbsrv over the
+serial port, or the socat pty that Hatari uses. Everything is passed through, except:
+	- qSupported and qXfer:features are fetched once and then answered locally.
+	- qXfer:memory-map is fetched once per inferior, and tells where reads are safe to extend.
+	- g and p are cached until the inferior is resumed or a register is written.
+	- m reads inside a memory map region are made in blocks, with read ahead, so
+	  adjacent small reads becomes one large read.
+	- Blocks in rom regions, the inferior text, are kept over stops until a stop
+	  reply says textchanged, or the inferior is restarted. The memory map is only
+	  fetched again when the inferior is restarted or exits.
+	- The registers and the top of the stack are read right after every stop,
+	  as gdb will ask for them.
+Non-stop mode turns the caches off, as memory then changes while gdb is talking.
+"""
+
+import argparse
+import os
+import pty
+import select
+import socket
+import sys
+import termios
+import time
+import tty
+import xml.etree.ElementTree as ElementTree
+
+BREAK = 0x03
+
+
+def checksum(raw):
+	return sum(raw) & 0xff
+
+
+def frame(raw, lead=b'$'):
+	return lead + raw + b'#' + b'%02x' % checksum(raw)
+
+
+def escape(data):
+	out = bytearray()
+	for c in data:
+		if c in b'$#}*':
+			out += bytes((0x7d, c ^ 0x20))
+		else:
+			out.append(c)
+	return bytes(out)
+
+
+def unescape(raw):
+	out = bytearray()
+	i = 0
+	while i < len(raw):
+		c = raw[i]
+		if c == 0x7d and i + 1 < len(raw):
+			i += 1
+			out.append(raw[i] ^ 0x20)
+		elif c == ord('*') and out and i + 1 < len(raw):
+			# Run length encoding.
+			i += 1
+			out += out[-1:] * (raw[i] - 29)
+		else:
+			out.append(c)
+		i += 1
+	return bytes(out)
+
+
+def is_console(reply):
+	return reply[:1] == b'O' and reply != b'OK'
+
+
+def parse_address(raw, sep=b','):
+	"""Returns the address and length, or kind, from "Xaddr,len..." packets."""
+	fields = raw[1:].split(b':', 1)[0].split(sep)
+	if raw[:1] in b'Zz':
+		fields = fields[1:]
+	try:
+		return int(fields[0], 16), int(fields[1].split(b';')[0], 16)
+	except (IndexError, ValueError):
+		return None, None
+
+
+class Link:
+	"""One end of a gdb remote connection, split into acks, breaks and packets."""
+
+	def __init__(self, fd, name, owner=None):
+		self.fd = fd
+		self.name = name
+		self.owner = owner		# Keeps a socket alive.
+		self.buf = bytearray()
+
+	def fileno(self):
+		return self.fd
+
+	def fill(self):
+		try:
+			data = os.read(self.fd, 4096)
+		except OSError:
+			data = b''
+		if not data:
+			raise EOFError(self.name)
+		self.buf += data
+
+	def send(self, data):
+		while data:
+			data = data[os.write(self.fd, data):]
+
+	def next_item(self):
+		"""
+		Returns ('$', raw, ok) for packets and ('%', raw, ok) for notifications, where raw is
+		the payload as sent. Acks and breaks are returned as ('+',), ('-',) and ('\\x03',).
+		Returns None if there is no complete item yet.
+		"""
+		while self.buf:
+			c = self.buf[0]
+			if c in b'$%':
+				end = self.buf.find(b'#', 1)
+				if end < 0 or len(self.buf) < end + 3:
+					return None
+				raw = bytes(self.buf[1:end])
+				try:
+					ok = int(self.buf[end + 1:end + 3], 16) == checksum(raw)
+				except ValueError:
+					ok = False
+				del self.buf[:end + 3]
+				return (chr(c), raw, ok)
+			del self.buf[0]
+			if c in b'+-' or c == BREAK:
+				return (chr(c),)
+		return None
+
+
+class Proxy:
+	def __init__(self, target, options):
+		self.target = target
+		self.gdb = None
+		self.options = options
+		self.target_noack = False
+		self.gdb_noack = False
+		self.nonstop = False
+		self.supported = None		# The target's qSupported reply.
+		self.packet_size = 0x400
+		self.xfer = {}				# (object, annex) -> document, kept as long as the target.
+		self.pending = None			# Request sent on, waiting for the reply.
+		self.last_to_target = b''
+		self.last_to_gdb = b''
+		self.stats = {'local': 0, 'forwarded': 0, 'target': 0}
+		self.drop_all()
+
+	def log(self, text):
+		if self.options.verbose:
+			sys.stderr.write('%9.3f %s\n' % (time.monotonic(), text))
+
+	def drop_stop(self):
+		"""Forgets what is only valid while the inferior is stopped."""
+		self.registers = None
+		self.register_replies = {}
+		self.ram_blocks = {}
+
+	def drop_text(self):
+		"""Forgets the cached text too, but keeps the memory map of the inferior."""
+		self.drop_stop()
+		self.rom_blocks = {}
+
+	def drop_all(self):
+		self.drop_text()
+		self.regions = None
+		self.xfer.pop(('memory-map', b''), None)
+
+	def invalidate(self, addr, length):
+		size = self.options.block
+		for blocks in (self.ram_blocks, self.rom_blocks):
+			for key in [k for k in blocks if k[0] < addr + length and k[0] + size > addr]:
+				del blocks[key]
+
+	# Target side.
+
+	def send_target(self, data):
+		self.last_to_target = data
+		self.target.send(data)
+
+	def target_reply(self, item):
+		"""Handles acks and notifications from the target. Returns the payload of a good packet."""
+		if item[0] == '-':
+			self.send_target(self.last_to_target)
+		elif item[0] == '%':
+			if self.gdb is not None:
+				self.gdb.send(frame(item[1], b'%'))
+		elif item[0] == '$':
+			if not self.target_noack:
+				self.target.send(b'+' if item[2] else b'-')
+			if item[2]:
+				return item[1]
+			self.log('target: bad checksum')
+		return None
+
+	def transact(self, raw):
+		"""Sends a request to the stopped target and waits for the reply."""
+		self.stats['target'] += 1
+		self.log('proxy> %s' % raw[:60])
+		self.send_target(frame(raw))
+		deadline = time.monotonic() + self.options.timeout
+		while True:
+			item = self.target.next_item()
+			if item is None:
+				left = deadline - time.monotonic()
+				if left <= 0 or not select.select([self.target], [], [], left)[0]:
+					raise TimeoutError('no reply to %s' % raw[:20])
+				self.target.fill()
+				continue
+			reply = self.target_reply(item)
+			if reply is None:
+				continue
+			if is_console(reply):
+				if self.gdb is not None:
+					self.gdb.send(frame(reply))
+				continue
+			return reply
+
+	def fetch_xfer(self, obj, annex):
+		key = (obj, annex)
+		if key not in self.xfer:
+			doc = bytearray()
+			chunk = self.packet_size - 5
+			while True:
+				reply = self.transact(b'qXfer:%s:read:%s:%x,%x' % (obj.encode(), annex, len(doc), chunk))
+				if not reply or reply[:1] not in b'ml':
+					return None
+				doc += unescape(reply[1:])
+				if reply[:1] == b'l':
+					break
+			self.xfer[key] = bytes(doc)
+		return self.xfer[key]
+
+	def supports(self, feature):
+		return self.supported is not None and feature in self.supported.split(b';')
+
+	def load_regions(self):
+		if self.regions is None:
+			self.regions = []
+			doc = self.fetch_xfer('memory-map', b'') if self.supports(b'qXfer:memory-map:read+') else None
+			if doc:
+				for memory in ElementTree.fromstring(doc).iter('memory'):
+					start = int(memory.get('start'), 0)
+					self.regions.append((start, start + int(memory.get('length'), 0), memory.get('type') == 'rom'))
+		return self.regions
+
+	def find_region(self, addr, length):
+		for region in self.load_regions():
+			if region[0] <= addr and addr + length <= region[1]:
+				return region
+		return None
+
+	def read_memory(self, addr, length):
+		"""Reads through the block cache. Returns None if the read must be left to the target."""
+		region = self.find_region(addr, length)
+		if region is None:
+			return None
+		start, end, rom = region
+		blocks = self.rom_blocks if rom else self.ram_blocks
+		size = self.options.block
+		max_read = max(size, (self.packet_size // 2) // size * size)
+		first = addr - addr % size
+		missing = [b for b in range(first, addr + length, size) if (b, start) not in blocks]
+		if missing:
+			# From the first missing block over the request and the read ahead, skipping what is cached.
+			to = max(addr + length, missing[0] + self.options.readahead)
+			to = min(end, to + (-to) % size)
+			b = missing[0]
+			while b < to:
+				if (b, start) in blocks:
+					b += size
+					continue
+				run = b
+				while run < to and run - b < max_read and (run, start) not in blocks:
+					run += size
+				lo = max(b, start)
+				hi = min(run, end)
+				reply = self.transact(b'm%x,%x' % (lo, hi - lo))
+				try:
+					data = bytes.fromhex(unescape(reply).decode())
+				except ValueError:
+					data = b''
+				if len(data) != hi - lo:
+					return None
+				for block in range(b, run, size):
+					blocks[(block, start)] = data[max(block, start) - lo:min(block + size, end) - lo]
+				b = run
+		data = b''.join(blocks[(b, start)] for b in range(first, addr + length, size))
+		skip = addr - max(first, start)
+		return data[skip:skip + length]
+
+	# gdb side.
+
+	def reply_gdb(self, raw):
+		self.stats['local'] += 1
+		self.log('<local %s' % raw[:60])
+		self.last_to_gdb = frame(raw)
+		self.gdb.send(self.last_to_gdb)
+
+	def local(self, raw):
+		"""Returns the reply if the request can be answered without passing it on, else None."""
+		if raw.startswith(b'qSupported'):
+			if self.supported is None:
+				self.supported = self.transact(raw)
+				for feature in self.supported.split(b';'):
+					if feature.startswith(b'PacketSize='):
+						self.packet_size = int(feature[11:], 16)
+			return self.supported
+		if raw == b'QStartNoAckMode':
+			if not self.target_noack:
+				reply = self.transact(raw)
+				if reply != b'OK':
+					return reply
+				self.target_noack = True
+			return b'OK'
+		if raw.startswith(b'qXfer:') and raw.count(b':') == 4:
+			_, obj, op, annex, span = raw.split(b':')
+			if op != b'read' or obj not in (b'features', b'memory-map'):
+				return None
+			doc = self.fetch_xfer(obj.decode(), annex)
+			if doc is None:
+				return None
+			offset, length = (int(v, 16) for v in span.split(b','))
+			part = doc[offset:offset + length]
+			return (b'l' if offset + length >= len(doc) else b'm') + escape(part)
+		if self.nonstop:
+			return None
+		if raw == b'g':
+			if self.registers is None:
+				reply = self.transact(raw)
+				if reply[:1] == b'E':
+					return reply
+				self.registers = reply
+			return self.registers
+		if raw[:1] == b'p':
+			n = int(raw[1:], 16)
+			if n not in self.register_replies:
+				if self.registers is not None and n < 18 and len(self.registers) >= (n + 1) * 8:
+					return self.registers[n * 8:(n + 1) * 8]
+				reply = self.transact(raw)
+				if reply[:1] == b'E':
+					return reply
+				self.register_replies[n] = reply
+			return self.register_replies[n]
+		if raw[:1] == b'm':
+			addr, length = parse_address(raw)
+			if addr is None or length == 0:
+				return None
+			data = self.read_memory(addr, length)
+			return data.hex().encode() if data is not None else None
+		return None
+
+	def before_forward(self, raw):
+		"""Drops what the request may change."""
+		c = raw[:1]
+		if raw.startswith((b'c', b's', b'C', b'S', b'vCont;')):
+			self.drop_stop()
+		elif c in b'MX':
+			addr, length = parse_address(raw)
+			if addr is None:
+				self.drop_text()
+			else:
+				self.invalidate(addr, length)
+		elif raw.startswith((b'Z0', b'z0', b'Z1', b'z1')):
+			addr, kind = parse_address(raw)
+			if addr is None:
+				self.drop_text()
+			else:
+				self.invalidate(addr, 2)
+		elif c in b'GP':
+			self.registers = None
+			self.register_replies = {}
+		elif raw.startswith(b'QNonStop:'):
+			self.nonstop = raw.endswith(b'1')
+			self.drop_all()
+		elif raw.startswith((b'vFile:', b'vCont?', b'vMustReplyEmpty', b'QSetWorkingDir:')):
+			pass
+		elif raw.startswith(b'qRcmd,'):
+			# Monitor commands may plant traps in text, but don't load or unload the inferior.
+			self.drop_text()
+		elif c in b'mgpqHT?!':
+			pass
+		else:
+			# Restarts, kills, monitor commands and anything unknown.
+			self.drop_all()
+
+	def after_reply(self, request, reply):
+		resume = request.startswith((b'c', b's', b'C', b'S', b'vCont;'))
+		if resume and reply[:1] in b'WX':
+			# The inferior is gone, and the next one has its text elsewhere.
+			self.drop_all()
+		elif resume and (reply[:1] != b'T' or b'textchanged:' in reply):
+			# Only a breakpoint stop tells if text have changed.
+			self.drop_text()
+		if (resume or request.startswith((b'vRun', b'vAttach', b'R'))) and reply[:1] in b'TS' and not self.nonstop:
+			self.prefetch()
+
+	def prefetch(self):
+		"""Reads what gdb asks for at every stop, while gdb is busy with the stop reply."""
+		try:
+			registers = self.local(b'g')
+			if self.options.stack > 0 and len(registers) >= 16 * 8:
+				sp = int(registers[15 * 8:16 * 8], 16)
+				self.read_memory(sp, self.options.stack)
+		except (ValueError, TimeoutError) as e:
+			self.log('prefetch: %s' % e)
+
+	def handle(self, raw):
+		if self.pending is not None:
+			# The target never answered the previous request, as with k and R.
+			self.pending = None
+		self.log('gdb> %s' % raw[:60])
+		try:
+			reply = self.local(raw)
+		except TimeoutError as e:
+			self.log(str(e))
+			reply = b'E01'
+		except ValueError:
+			# Malformed, let the target answer it.
+			reply = None
+		if reply is not None:
+			self.reply_gdb(reply)
+			return
+		self.before_forward(raw)
+		self.stats['forwarded'] += 1
+		self.stats['target'] += 1
+		self.pending = raw
+		self.send_target(frame(raw))
+
+	def from_gdb(self, item):
+		if item[0] == '-':
+			self.gdb.send(self.last_to_gdb)
+		elif item[0] == chr(BREAK):
+			self.target.send(bytes((BREAK,)))
+		elif item[0] == '$':
+			if item[1].startswith(b'qSupported'):
+				# gdb connected again, and starts out with acks.
+				self.gdb_noack = False
+			if not self.gdb_noack:
+				self.gdb.send(b'+' if item[2] else b'-')
+			if item[2]:
+				self.handle(item[1])
+				if item[1] == b'QStartNoAckMode' and self.target_noack:
+					self.gdb_noack = True
+
+	def from_target(self, item):
+		reply = self.target_reply(item)
+		if reply is None:
+			return
+		if self.gdb is not None:
+			self.last_to_gdb = frame(reply)
+			self.gdb.send(self.last_to_gdb)
+		if self.pending is not None and not is_console(reply):
+			request = self.pending
+			self.pending = None
+			self.log('<target %s' % reply[:60])
+			self.after_reply(request, reply)
+
+	def serve(self, gdb):
+		"""Relays until gdb disconnects."""
+		self.gdb = gdb
+		self.gdb_noack = False
+		try:
+			while True:
+				item = self.target.next_item()
+				while item is not None:
+					self.from_target(item)
+					item = self.target.next_item()
+				item = gdb.next_item()
+				while item is not None:
+					self.from_gdb(item)
+					item = gdb.next_item()
+				for link in select.select([self.target, gdb], [], [])[0]:
+					link.fill()
+		except EOFError as e:
+			if str(e) != gdb.name:
+				raise
+		finally:
+			self.gdb = None
+			self.log('gdb disconnected, %(local)d local replies, %(forwarded)d forwarded, %(target)d target requests' % self.stats)
+
+
+def open_target(spec, baud):
+	if ':' in spec and not os.path.exists(spec):
+		host, port = spec.rsplit(':', 1)
+		sock = socket.create_connection((host or 'localhost', int(port)))
+		return Link(sock.fileno(), 'target', sock)
+	fd = os.open(spec, os.O_RDWR | os.O_NOCTTY)
+	if os.isatty(fd):
+		tty.setraw(fd)
+		if baud:
+			attr = termios.tcgetattr(fd)
+			attr[4] = attr[5] = getattr(termios, 'B%d' % baud)
+			termios.tcsetattr(fd, termios.TCSANOW, attr)
+	return Link(fd, 'target')
+
+
+def main():
+	parser = argparse.ArgumentParser(description='Caching gdb remote protocol proxy for gdbsrv.ttp.')
+	parser.add_argument('target', help='serial port or pty connected to gdbsrv, or host:port')
+	parser.add_argument('--baud', type=int, default=0, help='set the serial port speed')
+	parser.add_argument('--listen', type=int, default=2345, help='TCP port for gdb (default 2345)')
+	parser.add_argument('--pty', help='make a pty for gdb and link it to this path, instead of TCP')
+	parser.add_argument('--block', type=int, default=64, help='memory cache block size (default 64)')
+	parser.add_argument('--readahead', type=int, default=256, help='bytes read at least, when a block is missing (default 256)')
+	parser.add_argument('--stack', type=int, default=128, help='stack bytes read at every stop, 0 for none (default 128)')
+	parser.add_argument('--timeout', type=float, default=10, help='seconds to wait for the target (default 10)')
+	parser.add_argument('-v', '--verbose', action='store_true', help='log the packets')
+	options = parser.parse_args()
+	if options.block <= 0 or options.block & 1:
+		parser.error('--block must be even')
+	proxy = Proxy(open_target(options.target, options.baud), options)
+	if options.pty:
+		master, slave = pty.openpty()
+		tty.setraw(slave)
+		if os.path.islink(options.pty):
+			os.remove(options.pty)
+		os.symlink(os.ttyname(slave), options.pty)
+		try:
+			# The slave is kept open, so gdb can come and go without the pty closing.
+			proxy.serve(Link(master, 'gdb'))
+		finally:
+			os.remove(options.pty)
+		return
+	server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+	server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+	server.bind(('localhost', options.listen))
+	server.listen(1)
+	while True:
+		sock, _ = server.accept()
+		sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+		proxy.serve(Link(sock.fileno(), 'gdb', sock))
+		sock.close()
+
+
+if __name__ == '__main__':
+	try:
+		main()
+	except KeyboardInterrupt:
+		pass
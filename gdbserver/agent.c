@@ -0,0 +1,697 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+#include <stdbool.h>
+#include "agent.h"
+#include "exceptions.h"
+#include "critical.h"
+#include "context.h"
+#include "hex.h"
+#include "console.h"
+#include "packet.h"
+#include "tracepoint.h"
+
+/*
+	Expressions are stored in fixed size slots, as we don't want to allocate memory.
+	Each expression in a slot is stored as a 16 bit length followed by the bytecode.
+	The stack is 32 bits wide, as that is all a 68000 target needs. 64 bit constants
+	that doesn't fit, and all floating point operations, are treated as errors.
+	So is an expression that runs more than AGENT_MAX_STEPS bytecodes.
+	printf output goes to the console buffer, and is sent to gdb at the next stop.
+	The trace bytecodes are only allowed when collecting a tracepoint frame.
+*/
+#define NUM_AGENT_SLOTS		16
+#define AGENT_SLOT_SIZE		256
+#define AGENT_STACK_SIZE	32
+#define AGENT_MAX_STEPS		4096	// Stops a looping expression from hanging the inferior.
+#define MAX_PRINTF_STRING	64		// Max number of chars printed from a %s.
+
+#define AGENT_OK			0
+#define AGENT_ERROR			1
+
+unsigned char agentSlots[NUM_AGENT_SLOTS][AGENT_SLOT_SIZE] __attribute__((aligned(2)));
+short agentSlotLength[NUM_AGENT_SLOTS];		// -1 if unused.
+bool agentSlotsInited = false;
+
+enum
+{
+	AX_FLOAT = 0x01, AX_ADD, AX_SUB, AX_MUL, AX_DIV_SIGNED, AX_DIV_UNSIGNED, AX_REM_SIGNED,
+	AX_REM_UNSIGNED, AX_LSH, AX_RSH_SIGNED, AX_RSH_UNSIGNED, AX_TRACE, AX_TRACE_QUICK, AX_LOG_NOT,
+	AX_BIT_AND, AX_BIT_OR, AX_BIT_XOR, AX_BIT_NOT, AX_EQUAL, AX_LESS_SIGNED, AX_LESS_UNSIGNED, AX_EXT,
+	AX_REF8, AX_REF16, AX_REF32, AX_REF64, AX_REF_FLOAT, AX_REF_DOUBLE, AX_REF_LONG_DOUBLE, AX_L_TO_D,
+	AX_D_TO_L, AX_IF_GOTO, AX_GOTO, AX_CONST8, AX_CONST16, AX_CONST32, AX_CONST64, AX_REG, AX_END,
+	AX_DUP, AX_POP, AX_ZERO_EXT, AX_SWAP, AX_GETV, AX_SETV, AX_TRACEV, AX_TRACENZ, AX_TRACE16,
+	AX_INVALID2, AX_PICK, AX_ROT, AX_PRINTF
+};
+
+void InitSlots(void)
+{
+	if (!agentSlotsInited)
+	{
+		AgentDiscardAll();
+	}
+}
+
+short AgentNewSlot(void)
+{
+	InitSlots();
+	for (short i = 0; i < NUM_AGENT_SLOTS; ++i)
+	{
+		if (agentSlotLength[i] < 0)
+		{
+			agentSlotLength[i] = 0;
+			return i;
+		}
+	}
+	return AGENT_NO_SLOT;
+}
+
+void AgentFreeSlot(short slot)
+{
+	if (slot >= 0 && slot < NUM_AGENT_SLOTS)
+	{
+		agentSlotLength[slot] = -1;
+	}
+}
+
+void AgentDiscardAll(void)
+{
+	for (short i = 0; i < NUM_AGENT_SLOTS; ++i)
+	{
+		agentSlotLength[i] = -1;
+	}
+	agentSlotsInited = true;
+}
+
+bool AgentAddExpression(short slot, const char* hex, unsigned short len)
+{
+	if (slot < 0 || slot >= NUM_AGENT_SLOTS || len == 0 ||
+		(agentSlotLength[slot] + 2 + len) > AGENT_SLOT_SIZE)
+	{
+		return false;
+	}
+	unsigned char* ptr = &agentSlots[slot][agentSlotLength[slot]];
+	*ptr++ = (unsigned char)(len >> 8);
+	*ptr++ = (unsigned char)len;
+	for (unsigned short i = 0; i < len; ++i)
+	{
+		*ptr++ = HexToByte((char*)hex);
+		hex += 2;
+	}
+	agentSlotLength[slot] += 2 + len;
+	return true;
+}
+
+/*
+	Parses agent expressions from the in packet, "Xlen,expr" repeated without separators.
+	The expressions are added to slot, a new slot is taken if it is AGENT_NO_SLOT.
+	Returns the offset after the last expression, or -1 on errors, in which case the slot is freed.
+*/
+short AgentParseExpressions(short offset, short* slot)
+{
+	char* inptr = GetInpacketPtr(0);
+	short length = GetInPacketLength();
+	if (*slot == AGENT_NO_SLOT)
+	{
+		*slot = AgentNewSlot();
+	}
+	while (offset > 0 && offset < length && inptr[offset] == 'X')
+	{
+		unsigned int len;
+		offset = ReadNumber(offset + 1, &len);
+		if (offset < 0 || inptr[offset] != ',' || (offset + 1 + (int)(len * 2)) > length ||
+			!AgentAddExpression(*slot, inptr + offset + 1, (unsigned short)len))
+		{
+			offset = -1;
+		}
+		else
+		{
+			offset += 1 + (short)(len * 2);
+		}
+	}
+	// An empty list, like "cmds:0," without expressions, must not leave an empty slot behind.
+	if (offset < 0 || (*slot >= 0 && agentSlotLength[*slot] == 0))
+	{
+		AgentFreeSlot(*slot);
+		*slot = AGENT_NO_SLOT;
+	}
+	return offset;
+}
+
+bool AgentConditionTrue(short slot)
+{
+	if (slot < 0 || slot >= NUM_AGENT_SLOTS || agentSlotLength[slot] <= 0)
+	{
+		// No conditions, always true.
+		return true;
+	}
+	unsigned char* ptr = agentSlots[slot];
+	unsigned char* end = ptr + agentSlotLength[slot];
+	while (ptr < end)
+	{
+		unsigned short len = (ptr[0] << 8) | ptr[1];
+		unsigned int result;
+		if (AgentEval(ptr + 2, len, &result) != AGENT_OK || result != 0)
+		{
+			return true;
+		}
+		ptr += 2 + len;
+	}
+	return false;
+}
+
+void AgentRunCommands(short slot)
+{
+	if (slot < 0 || slot >= NUM_AGENT_SLOTS || agentSlotLength[slot] <= 0)
+	{
+		return;
+	}
+	unsigned char* ptr = agentSlots[slot];
+	unsigned char* end = ptr + agentSlotLength[slot];
+	while (ptr < end)
+	{
+		unsigned short len = (ptr[0] << 8) | ptr[1];
+		unsigned int result;
+		AgentEval(ptr + 2, len, &result);
+		ptr += 2 + len;
+	}
+}
+
+// Reads big endian memory as the inferior sees it.
+bool ReadAgentMemory(unsigned int addr, short size, unsigned int* value)
+{
+	unsigned int v = 0;
+	for (short i = 0; i < size; ++i)
+	{
+		unsigned char c;
+		if (ExceptionSafeMemoryRead(InferiorContextMemoryAddress((unsigned char*)addr + i), &c) != 0)
+		{
+			return false;
+		}
+		v = (v << 8) | c;
+	}
+	*value = v;
+	return true;
+}
+
+void PrintfPadded(const char* str, short len, short width, bool left, char pad)
+{
+	// Zero padding goes after the sign.
+	if (pad == '0' && len > 0 && *str == '-')
+	{
+		ConsolePutChar(*str++);
+		--len;
+		--width;
+	}
+	if (!left)
+	{
+		for (short i = len; i < width; ++i)
+		{
+			ConsolePutChar(pad);
+		}
+	}
+	for (short i = 0; i < len; ++i)
+	{
+		ConsolePutChar(str[i]);
+	}
+	if (left)
+	{
+		for (short i = len; i < width; ++i)
+		{
+			ConsolePutChar(' ');
+		}
+	}
+}
+
+/*
+	Supports the conversions d, i, u, x, X, o, p, c, s and %, with the flags '-' and '0',
+	and a field width. Precision and length modifiers are accepted but ignored, all
+	arguments are 32 bits.
+*/
+void AgentPrintf(const char* format, short nargs, const unsigned int* args)
+{
+	short argi = 0;
+	char c;
+	while ((c = *format++) != 0)
+	{
+		if (c != '%')
+		{
+			ConsolePutChar(c);
+			continue;
+		}
+		bool left = false;
+		char pad = ' ';
+		for (;; ++format)
+		{
+			if (*format == '-')
+			{
+				left = true;
+			}
+			else if (*format == '0')
+			{
+				pad = '0';
+			}
+			else if (*format != ' ' && *format != '+' && *format != '#')
+			{
+				break;
+			}
+		}
+		short width = 0;
+		while (*format >= '0' && *format <= '9')
+		{
+			width = (short)((width << 3) + (width << 1) + (*format++ - '0'));
+		}
+		if (*format == '.')
+		{
+			++format;
+			while (*format >= '0' && *format <= '9')
+			{
+				++format;
+			}
+		}
+		while (*format == 'l' || *format == 'h' || *format == 'z')
+		{
+			++format;
+		}
+		char conv = *format;
+		if (conv == 0)
+		{
+			break;
+		}
+		++format;
+		if (conv == '%')
+		{
+			ConsolePutChar('%');
+			continue;
+		}
+		unsigned int v = argi < nargs ? args[argi++] : 0;
+		char buf[MAX_PRINTF_STRING];
+		short len = 0;
+		unsigned int base = 10;
+		bool upper = false;
+		bool negative = false;
+		switch (conv)
+		{
+		case 'd':
+		case 'i':
+			negative = (int)v < 0;
+			if (negative)
+			{
+				v = -v;
+			}
+			break;
+		case 'u':
+			break;
+		case 'X':
+			upper = true;
+			base = 16;
+			break;
+		case 'x':
+		case 'p':
+			base = 16;
+			break;
+		case 'o':
+			base = 8;
+			break;
+		case 'c':
+			buf[len++] = (char)v;
+			base = 0;
+			break;
+		case 's':
+			while (len < MAX_PRINTF_STRING && ReadAgentMemory(v + len, 1, &base) && base != 0)
+			{
+				buf[len++] = (char)base;
+			}
+			base = 0;
+			break;
+		default:
+			// Unknown conversion, print it as is.
+			buf[len++] = '%';
+			buf[len++] = conv;
+			base = 0;
+			break;
+		}
+		if (base != 0)
+		{
+			// Digits are written backwards from the end of the buffer.
+			char* ptr = buf + sizeof(buf);
+			do
+			{
+				char d = (char)(v % base);
+				*--ptr = (char)(d < 10 ? '0' + d : (upper ? 'A' : 'a') + d - 10);
+				v /= base;
+			} while (v != 0);
+			if (conv == 'p')
+			{
+				*--ptr = 'x';
+				*--ptr = '0';
+			}
+			if (negative)
+			{
+				*--ptr = '-';
+			}
+			len = (short)((buf + sizeof(buf)) - ptr);
+			PrintfPadded(ptr, len, width, left, pad);
+		}
+		else
+		{
+			PrintfPadded(buf, len, width, left, ' ');
+		}
+	}
+}
+
+int AgentEval(const unsigned char* code, unsigned short len, unsigned int* result)
+{
+	unsigned int stack[AGENT_STACK_SIZE];
+	short sp = 0;			// Number of items on stack.
+	unsigned short pc = 0;
+	unsigned short steps = 0;
+
+	#define NEED(items, bytes) if (sp < (items) || (pc + (bytes)) > len) {return AGENT_ERROR;}
+	#define PUSH(v) if (sp >= AGENT_STACK_SIZE) {return AGENT_ERROR;} stack[sp++] = (v)
+	#define TOP stack[sp - 1]
+	#define NEXT stack[sp - 2]
+	#define ARG16 ((code[pc] << 8) | code[pc + 1])
+
+	while (pc < len)
+	{
+		if (++steps > AGENT_MAX_STEPS)
+		{
+			return AGENT_ERROR;
+		}
+		unsigned char op = code[pc++];
+		unsigned int v;
+		switch (op)
+		{
+		case AX_ADD:
+			NEED(2, 0);
+			NEXT += TOP;
+			--sp;
+			break;
+		case AX_SUB:
+			NEED(2, 0);
+			NEXT -= TOP;
+			--sp;
+			break;
+		case AX_MUL:
+			NEED(2, 0);
+			NEXT *= TOP;
+			--sp;
+			break;
+		case AX_DIV_SIGNED:
+		case AX_DIV_UNSIGNED:
+		case AX_REM_SIGNED:
+		case AX_REM_UNSIGNED:
+			NEED(2, 0);
+			if (TOP == 0)
+			{
+				return AGENT_ERROR;
+			}
+			if (op == AX_DIV_SIGNED)
+			{
+				NEXT = (unsigned int)((int)NEXT / (int)TOP);
+			}
+			else if (op == AX_DIV_UNSIGNED)
+			{
+				NEXT /= TOP;
+			}
+			else if (op == AX_REM_SIGNED)
+			{
+				NEXT = (unsigned int)((int)NEXT % (int)TOP);
+			}
+			else
+			{
+				NEXT %= TOP;
+			}
+			--sp;
+			break;
+		case AX_LSH:
+			NEED(2, 0);
+			NEXT = TOP < 32 ? NEXT << TOP : 0;
+			--sp;
+			break;
+		case AX_RSH_SIGNED:
+			NEED(2, 0);
+			NEXT = (unsigned int)((int)NEXT >> (TOP < 32 ? TOP : 31));
+			--sp;
+			break;
+		case AX_RSH_UNSIGNED:
+			NEED(2, 0);
+			NEXT = TOP < 32 ? NEXT >> TOP : 0;
+			--sp;
+			break;
+		case AX_LOG_NOT:
+			NEED(1, 0);
+			TOP = TOP == 0;
+			break;
+		case AX_BIT_AND:
+			NEED(2, 0);
+			NEXT &= TOP;
+			--sp;
+			break;
+		case AX_BIT_OR:
+			NEED(2, 0);
+			NEXT |= TOP;
+			--sp;
+			break;
+		case AX_BIT_XOR:
+			NEED(2, 0);
+			NEXT ^= TOP;
+			--sp;
+			break;
+		case AX_BIT_NOT:
+			NEED(1, 0);
+			TOP = ~TOP;
+			break;
+		case AX_EQUAL:
+			NEED(2, 0);
+			NEXT = NEXT == TOP;
+			--sp;
+			break;
+		case AX_LESS_SIGNED:
+			NEED(2, 0);
+			NEXT = (int)NEXT < (int)TOP;
+			--sp;
+			break;
+		case AX_LESS_UNSIGNED:
+			NEED(2, 0);
+			NEXT = NEXT < TOP;
+			--sp;
+			break;
+		case AX_EXT:
+			NEED(1, 1);
+			v = code[pc++];
+			if (v > 0 && v < 32)
+			{
+				TOP = (unsigned int)(((int)(TOP << (32 - v))) >> (32 - v));
+			}
+			break;
+		case AX_ZERO_EXT:
+			NEED(1, 1);
+			v = code[pc++];
+			if (v < 32)
+			{
+				TOP &= (1 << v) - 1;
+			}
+			break;
+		case AX_REF8:
+		case AX_REF16:
+		case AX_REF32:
+			NEED(1, 0);
+			if (!ReadAgentMemory(TOP, (short)(1 << (op - AX_REF8)), &TOP))
+			{
+				return AGENT_ERROR;
+			}
+			break;
+		case AX_IF_GOTO:
+			NEED(1, 2);
+			v = ARG16;
+			pc += 2;
+			if (stack[--sp] != 0)
+			{
+				pc = (unsigned short)v;
+			}
+			break;
+		case AX_GOTO:
+			NEED(0, 2);
+			pc = ARG16;
+			break;
+		case AX_CONST8:
+			NEED(0, 1);
+			PUSH(code[pc]);
+			pc += 1;
+			break;
+		case AX_CONST16:
+			NEED(0, 2);
+			PUSH(ARG16);
+			pc += 2;
+			break;
+		case AX_CONST32:
+		case AX_CONST64:
+			NEED(0, op == AX_CONST32 ? 4 : 8);
+			if (op == AX_CONST64)
+			{
+				// Only allowed if it fits in 32 bits.
+				v = (ARG16 << 16) | ((code[pc + 2] << 8) | code[pc + 3]);
+				pc += 4;
+				if (v != 0 && v != 0xffffffff)
+				{
+					return AGENT_ERROR;
+				}
+			}
+			v = (ARG16 << 16) | ((code[pc + 2] << 8) | code[pc + 3]);
+			pc += 4;
+			PUSH(v);
+			break;
+		case AX_REG:
+			NEED(0, 2);
+			v = ARG16;
+			pc += 2;
+			if (v >= 18)
+			{
+				// Fpu registers doesn't fit on the stack.
+				return AGENT_ERROR;
+			}
+			PUSH(((unsigned int*)GetRegisters())[v]);
+			break;
+		case AX_END:
+			// Commands may end with an empty stack.
+			*result = sp > 0 ? TOP : 0;
+			return AGENT_OK;
+		case AX_DUP:
+			NEED(1, 0);
+			v = TOP;
+			PUSH(v);
+			break;
+		case AX_POP:
+			NEED(1, 0);
+			--sp;
+			break;
+		case AX_SWAP:
+			NEED(2, 0);
+			v = TOP;
+			TOP = NEXT;
+			NEXT = v;
+			break;
+		case AX_PICK:
+			NEED(1, 1);
+			v = code[pc++];
+			if (v >= (unsigned int)sp)
+			{
+				return AGENT_ERROR;
+			}
+			v = stack[sp - 1 - v];
+			PUSH(v);
+			break;
+		case AX_ROT:
+			NEED(3, 0);
+			// (a b c => c a b)
+			v = TOP;
+			TOP = NEXT;
+			NEXT = stack[sp - 3];
+			stack[sp - 3] = v;
+			break;
+		case AX_PRINTF:
+			{
+				// nargs, format length and format, function and channel on stack followed by arguments.
+				NEED(0, 3);
+				short nargs = code[pc];
+				unsigned short slen = (code[pc + 1] << 8) | code[pc + 2];
+				pc += 3;
+				NEED(2 + nargs, slen);
+				const char* format = (const char*)(code + pc);
+				pc += slen;
+				if (slen == 0 || format[slen - 1] != 0)
+				{
+					return AGENT_ERROR;
+				}
+				sp -= 2;	// We only have one way to print, so function and channel are ignored.
+				unsigned int args[AGENT_STACK_SIZE];
+				for (short i = 0; i < nargs; ++i)
+				{
+					args[i] = stack[--sp];
+				}
+				AgentPrintf(format, nargs, args);
+			}
+			break;
+		case AX_TRACE:
+			NEED(2, 0);
+			if (!TraceCollectMemory(NEXT, TOP))
+			{
+				return AGENT_ERROR;
+			}
+			sp -= 2;
+			break;
+		case AX_TRACE_QUICK:
+		case AX_TRACE16:
+			NEED(1, op == AX_TRACE16 ? 2 : 1);
+			if (op == AX_TRACE16)
+			{
+				v = ARG16;
+				pc += 2;
+			}
+			else
+			{
+				v = code[pc++];
+			}
+			if (!TraceCollectMemory(TOP, v))
+			{
+				return AGENT_ERROR;
+			}
+			break;
+		case AX_TRACENZ:
+			{
+				// Collects a string, up to size bytes or the terminating zero.
+				NEED(2, 0);
+				unsigned int c = 1;
+				for (v = 0; v < TOP && c != 0; ++v)
+				{
+					if (!ReadAgentMemory(NEXT + v, 1, &c))
+					{
+						break;
+					}
+				}
+				if (!TraceCollectMemory(NEXT, v))
+				{
+					return AGENT_ERROR;
+				}
+				sp -= 2;
+			}
+			break;
+		case AX_TRACEV:
+			// Trace state variables are read from the target, so they are not collected in frames.
+			NEED(0, 2);
+			pc += 2;
+			break;
+		case AX_GETV:
+			NEED(0, 2);
+			if (!TraceGetVariable(ARG16, &v))
+			{
+				return AGENT_ERROR;
+			}
+			pc += 2;
+			PUSH(v);
+			break;
+		case AX_SETV:
+			NEED(1, 2);
+			if (!TraceSetVariable(ARG16, TOP))
+			{
+				return AGENT_ERROR;
+			}
+			pc += 2;
+			break;
+		default:
+			// Floating point and anything unknown.
+			return AGENT_ERROR;
+		}
+	}
+	return AGENT_ERROR;	// Expression without end.
+
+	#undef NEED
+	#undef PUSH
+	#undef TOP
+	#undef NEXT
+	#undef ARG16
+}
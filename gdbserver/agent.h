@@ -0,0 +1,45 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+/*
+	Interpreter for gdb agent expressions.
+	https://sourceware.org/gdb/current/onlinedocs/gdb.html/Agent-Expressions.html
+*/
+#ifndef AGENT_DEFINED
+#define AGENT_DEFINED
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AGENT_NO_SLOT	-1
+
+// Returns a free slot for storing expressions, or AGENT_NO_SLOT if there is none.
+short AgentNewSlot(void);
+void AgentFreeSlot(short slot);
+void AgentDiscardAll(void);
+
+// Adds an expression to a slot, from len bytes of hex encoded bytecode.
+bool AgentAddExpression(short slot, const char* hex, unsigned short len);
+
+// Parses "Xlen,expr" blocks from the in packet into slot, taking a new slot if it is AGENT_NO_SLOT.
+short AgentParseExpressions(short offset, short* slot);
+
+// Returns true if any expression in the slot is non zero, or if any fails to evaluate.
+bool AgentConditionTrue(short slot);
+
+// Evaluates all expressions in the slot, ignoring the results.
+void AgentRunCommands(short slot);
+
+// Returns 0 if evaluated without errors.
+int AgentEval(const unsigned char* code, unsigned short len, unsigned int* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AGENT_DEFINED
@@ -150,6 +150,33 @@ struct DTA* Fgetdta(unsigned short bios_handle)
 	return result;
 }
 
+int Fsfirst(const char* bios_path, unsigned short bios_attrib)
+{
+	register int result asm ("d0") = -1;
+	__asm__ volatile (
+		TRAP_BEGIN
+		"move.w		%2, %%a7@-\n\t"
+		"move.l		%1, %%a7@-\n\t"
+		TRAP_FUNC(1, 0x4e)
+		: "=r" (result)
+		: "r" (bios_path), "r" (bios_attrib)
+		: CLOBBER_REG);
+	return result;
+}
+
+void* Malloc(int amount)
+{
+	register void* result asm ("d0") = 0;
+	__asm__ volatile (
+		TRAP_BEGIN
+		"move.l		%1, %%a7@-\n\t"
+		TRAP_FUNC(1, 0x48)
+		: "=r" (result)
+		: "r" (amount)
+		: CLOBBER_REG);
+	return result;
+}
+
 int Mfree(void* start_addr)
 {
 	register int result asm ("d0") = -1;
@@ -179,6 +206,18 @@ int Pexec(unsigned short mode, const char* file_name, const char* cmdline, const
 	return result;
 }
 
+unsigned short Sversion(void)
+{
+	register unsigned int result asm ("d0") = 0;
+	__asm__ volatile (
+		TRAP_BEGIN
+		TRAP_FUNC(1, 0x30)
+		: "=r" (result)
+		:
+		: CLOBBER_REG);
+	return (unsigned short)result;
+}
+
 void __attribute__ ((noreturn)) Pterm(unsigned short retcode)
 {
 	__asm__ volatile (
@@ -32,6 +32,12 @@ int Fwrite(unsigned short bios_handle, int length, const void* buf);
 
 struct DTA* Fgetdta(unsigned short bios_handle);
 
+// Fills in the current DTA, as returned by Fgetdta.
+int Fsfirst(const char* bios_path, unsigned short bios_attrib);
+
+// An amount of -1 returns the size of the largest free block.
+void* Malloc(int amount);
+
 int Mfree(void* start_addr);
 
 #define PE_LOADGO		0
@@ -39,8 +45,12 @@ int Mfree(void* start_addr);
 #define PE_GO			4
 #define PE_BASEPAGE		5
 #define PE_GOTHENFREE	6
+#define PE_CBASEPAGE	7		// As PE_BASEPAGE, with the program flags in place of file_name.
 int Pexec(unsigned short mode, const char* file_name, const char* cmdline, const char* envstring);
 
+// GEMDOS version, with the major number in the low byte.
+unsigned short Sversion(void);
+
 void __attribute__ ((noreturn)) Pterm(unsigned short retcode);
 
 #define DEV_PRINTER		0
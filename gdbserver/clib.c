@@ -54,6 +54,108 @@ void* memset(void *ptr, int value, size_t num)
 	return ptr;
 }
 
+void* memcpy(void *dest, const void *src, size_t num)
+{
+	if (num > 0)
+	{
+	__asm__ volatile (
+		"move.l	%0, %%a0\n\t"
+		"move.l	%1, %%a1\n\t"
+		"move.l	%2, %%d0\n\t"
+		"1:\n\t"
+		"move.b	%%a1@+, %%a0@+\n\t"
+		"subq.l #1, %%d0\n\t"
+		"bne.s	1b\n\t"
+		:
+		: "g" (dest), "g" (src), "g" (num)
+		: "a0", "a1", "d0", "cc", "memory");
+	}
+	return dest;
+}
+
+/*
+	The 68000 can only multiply and divide 16 bit values, so gcc calls libgcc for 32 bit
+	multiplications, divisions and modulo.
+*/
+unsigned int __mulsi3(unsigned int a, unsigned int b)
+{
+	// Low 32 bits of the product, same for signed and unsigned.
+	register unsigned int result asm ("d0");
+	__asm__ volatile (
+		"move.l	%1, %0\n\t"
+		"move.l	%2, %%d1\n\t"
+		"move.w	%%d1, %%d2\n\t"		// bl
+		"swap	%%d1\n\t"
+		"mulu.w	%0, %%d1\n\t"		// bh * al
+		"swap	%0\n\t"
+		"mulu.w	%%d2, %0\n\t"		// ah * bl
+		"add.w	%%d1, %0\n\t"
+		"swap	%0\n\t"
+		"clr.w	%0\n\t"				// (ah * bl + bh * al) << 16
+		"move.l	%1, %%d1\n\t"
+		"mulu.w	%%d2, %%d1\n\t"		// al * bl
+		"add.l	%%d1, %0\n\t"
+		: "=&d" (result)
+		: "g" (a), "g" (b)
+		: "d1", "d2", "cc");
+	return result;
+}
+
+// Shift and subtract division. Division by zero gives 0xffffffff without any exception.
+unsigned int UnsignedDivide(unsigned int a, unsigned int b, unsigned int* remainder)
+{
+	register unsigned int rem asm ("d0");
+	register unsigned int quot asm ("d1");
+	__asm__ volatile (
+		"move.l	%2, %1\n\t"
+		"move.l	%3, %%d2\n\t"
+		"moveq	#0, %0\n\t"
+		"moveq	#31, %%d3\n\t"
+		"1:\n\t"
+		"add.l	%1, %1\n\t"			// Next dividend bit to x
+		"addx.l	%0, %0\n\t"
+		"bcs.s	2f\n\t"				// Remainder overflowed, so it is larger than divisor.
+		"cmp.l	%%d2, %0\n\t"
+		"bcs.s	3f\n\t"
+		"2:\n\t"
+		"sub.l	%%d2, %0\n\t"
+		"addq.l	#1, %1\n\t"
+		"3:\n\t"
+		"dbra	%%d3, 1b\n\t"
+		: "=&d" (rem), "=&d" (quot)
+		: "g" (a), "g" (b)
+		: "d2", "d3", "cc");
+	*remainder = rem;
+	return quot;
+}
+
+unsigned int __udivsi3(unsigned int a, unsigned int b)
+{
+	unsigned int rem;
+	return UnsignedDivide(a, b, &rem);
+}
+
+unsigned int __umodsi3(unsigned int a, unsigned int b)
+{
+	unsigned int rem;
+	UnsignedDivide(a, b, &rem);
+	return rem;
+}
+
+int __divsi3(int a, int b)
+{
+	unsigned int rem;
+	unsigned int quot = UnsignedDivide(a < 0 ? -a : a, b < 0 ? -b : b, &rem);
+	return ((a ^ b) < 0) ? -(int)quot : (int)quot;
+}
+
+int __modsi3(int a, int b)
+{
+	unsigned int rem;
+	UnsignedDivide(a < 0 ? -a : a, b < 0 ? -b : b, &rem);
+	return a < 0 ? -(int)rem : (int)rem;
+}
+
 // Note! Compares str_a with str_b *up to the length* of str_a.
 // Returns: -1 if not equal, and length of str_a if equal.
 // Returns 0 if str_a is length 0, and as such, is a dumb string to compare.
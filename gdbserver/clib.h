@@ -12,6 +12,16 @@ size_t strlen(const char* s);
 
 void* memset(void *ptr, int value, size_t num);
 
+void* memcpy(void *dest, const void *src, size_t num);
+
+// 32 bit multiplication and division, called by gcc generated code.
+unsigned int __mulsi3(unsigned int a, unsigned int b);
+unsigned int UnsignedDivide(unsigned int a, unsigned int b, unsigned int* remainder);
+unsigned int __udivsi3(unsigned int a, unsigned int b);
+unsigned int __umodsi3(unsigned int a, unsigned int b);
+int __divsi3(int a, int b);
+int __modsi3(int a, int b);
+
 short StringCompare(const char* str_a, const char* str_b);
 
 char* StrCopy(const char* source, char* dest);
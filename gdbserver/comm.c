@@ -8,19 +8,26 @@
 #include "server.h"
 #include "clib.h"
 #include "cookies.h"
+#include "live.h"
 
 int CheckServerQuitKey(void);
 
 volatile short CtrlC_enable;
+volatile short CtrlC_packets;
+volatile unsigned short CtrlC_char;
 volatile unsigned char Mfp_ActiveEdgeRegister;
 volatile unsigned char Scc_StatusRegister;
 volatile unsigned short sccTmpData;
 
 void InitMfpAux(_CommException CommException);
 void ExitMfpAux(void);
+void MfpDirectPutByte(unsigned char byte);
+bool MfpDirectReady(void);
 
 void InitSccAux(_CommException CommException);
 void ExitSccAux(void);
+void SccDirectPutByte(unsigned char byte);
+bool SccDirectReady(void);
 
 int SccBcostat(void);
 int SccBconout(void);
@@ -77,12 +84,16 @@ int Mfp_Init(const char *comString, _CommException CommException)
 	// Set DTR to ON
 	Ongibit(GI_DTR);
 
+	LiveTransmit = MfpDirectPutByte;
+	LiveTransmitReady = MfpDirectReady;
+
 	return 0;
 }
 
 
 void Mfp_Exit(void)
 {
+	LiveTransmit = 0;
 	// Set DTR to OFF
 	Offgibit(GI_DTR);
 	ExitMfpAux();
@@ -126,9 +137,25 @@ int Mfp_ReceiveByte(void)
 
 void SetCtrlCFlag(bool enable)
 {
+	if (enable)
+	{
+		LiveReset();
+	}
 	CtrlC_enable = enable ? 1 : 0;
 }
 
+void EnablePacketBreak(bool enable)
+{
+	CtrlC_packets = enable ? 1 : 0;
+}
+
+bool PacketBreakReceived(void)
+{
+	bool packet = CtrlC_char == '$';
+	CtrlC_char = 0;
+	return packet;
+}
+
 const char*	Mfp_DeviceName(void)
 {
 	return "MFP serial device.\r\n";
@@ -164,12 +191,15 @@ bool Scc_IsMyDevice(const char *comString)
 int Scc_Init(const char *comString, _CommException CommException)
 {
 	InitSccAux(CommException);
+	LiveTransmit = SccDirectPutByte;
+	LiveTransmitReady = SccDirectReady;
 	
 	return 0;
 }
 
 void Scc_Exit(void)
 {
+	LiveTransmit = 0;
 	ExitSccAux();
 }
 
@@ -39,6 +39,14 @@ typedef struct _comm
 
 extern comm* comDev;
 
+/*
+	For non-stop mode, lets the AUX interrupts break into the server on the start of
+	a packet, and not only on CTRL-C. The '$' is consumed by the interrupt.
+*/
+void EnablePacketBreak(bool enable);
+// Returns true if the last break was a packet start, and clears it.
+bool PacketBreakReceived(void);
+
 int GetByte(void);
 void PutByte(char ch);
 
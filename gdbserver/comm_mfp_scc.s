@@ -5,6 +5,8 @@
 
 	.global Mfp_ActiveEdgeRegister
 	.global CtrlC_enable
+	.global CtrlC_packets
+	.global CtrlC_char
 	.global sccTmpData
 	.global sccDelayCount
 
@@ -40,24 +42,93 @@ ExitMfpAux:
 	rts
 	.endfunc
 
+/*
+	While the inferior runs, CTRL-C breaks into the server. In non-stop mode (CtrlC_packets set)
+	so does the start of a packet, and the server reads the rest of it.
+	The byte that caused the break is left in CtrlC_char.
+	Side-band requests (live.h) are answered by LiveInput without breaking.
+*/
 MfpSerialInput:
 	tst.w	CtrlC_enable
 	beq.s	oMfpSerialInput
 	btst	#7, 0xfffffa2b.w
 	beq.s	o2MfpSerialInput
-	cmp.b	#3, 0xfffffa2f.w	| CTRL-C from gdb
-	bne.s	o2MfpSerialInput
+	movem.l	d0-d1/a0-a1, -(a7)
+	moveq	#0, d1
+	move.b	0xfffffa2f.w, d1
+	move.l	d1, -(a7)
+	jbsr	LiveInput
+	move.l	(a7)+, d1
+	tst.b	d0
+	bne.s	2f					| Side-band request
+	cmp.b	#3, d1				| CTRL-C from gdb
+	beq.s	1f
+	tst.w	CtrlC_packets
+	beq.s	2f
+	cmp.b	#0x24, d1			| '$', packet from gdb
+	bne.s	2f
+1:
+	move.w	d1, CtrlC_char
+	movem.l	(a7)+, d0-d1/a0-a1
 	ori.w	#0x700, sr
 	clr.w	CtrlC_enable	| Clear CtrlC_enable so we don't handle that while the server context is running. 
 	move.b	#0xef, 0xfffffa0f.w	| enable irq again so serial comm works in server.
 MfpSerialExceptionCall:
 	jmp		0x12345678
+2:
+	movem.l	(a7)+, d0-d1/a0-a1
 o2MfpSerialInput:
 	move.b	#0xef, 0xfffffa0f.w
 	rte
 oMfpSerialInput:
 	jmp 	0x12345678
 
+/*
+	Sends a byte without the BIOS or interrupts, for LiveInput.
+*/
+	.global MfpDirectPutByte
+MfpDirectPutByte:
+	.func MfpDirectPutByte
+1:
+	btst	#7, 0xfffffa2d.w	| Transmit buffer empty
+	beq.s	1b
+	move.b	7(a7), 0xfffffa2f.w
+	rts
+	.endfunc
+
+	.global MfpDirectReady
+MfpDirectReady:
+	.func MfpDirectReady
+	moveq	#0, d0
+	btst	#7, 0xfffffa2d.w	| Transmit buffer empty
+	beq.s	1f
+	moveq	#1, d0
+1:
+	rts
+	.endfunc
+
+/*
+	MFP timer A interrupt for the periodic sampling in live.c.
+	Only installed in the inferior context.
+*/
+	.global LiveSampleTimer
+LiveSampleTimer:
+	movem.l	d0-d1/a0-a1, -(a7)
+	jbsr	LiveSampleTick
+	movem.l	(a7)+, d0-d1/a0-a1
+	move.b	#0xdf, 0xfffffa0f.w	| Clear in service bit
+	rte
+
+/*
+	MFP timer B interrupt for "monitor time" in timing.c, counts the timer wraps.
+	Only installed in the inferior context.
+*/
+	.global TimeTimer
+TimeTimer:
+	addq.l	#1, timeWraps
+	move.b	#0xfe, 0xfffffa0f.w	| Clear in service bit
+	rte
+
 MfpDcd:
 	move.b	0xfffffa03.w, Mfp_ActiveEdgeRegister
 oMfpDcd:
@@ -212,9 +283,23 @@ SccSerialRX:
 	jbsr	SccDelay
 	tst.w	CtrlC_enable
 	jeq		SccSerialReceive	| This is a normal receive
+	and.l	#0xff, d1
+	movem.l	d1/a1, -(a7)
+	move.l	d1, -(a7)
+	jbsr	LiveInput
+	addq.l	#4, a7
+	movem.l	(a7)+, d1/a1
+	tst.b	d0
+	jne		SccSerialRXExit		| Side-band request
 	cmp.b	#3, d1
-	jne		SccSerialRXExit		| No CTRL-C, discard the data and continue
+	jeq		1f
+	tst.w	CtrlC_packets
+	jeq		SccSerialRXExit		| No CTRL-C, discard the data and continue
+	cmp.b	#0x24, d1
+	jne		SccSerialRXExit		| No packet start either
+1:
 	| Break the execution of the inferior.
+	move.w	d1, CtrlC_char
 	ori.w	#0x700, sr
 	clr.w	CtrlC_enable	| Clear CtrlC_enable so we don't handle that while the server context is running. 
 	moveq	#0x30, d0
@@ -249,6 +334,38 @@ SccSerialRXExit:
 	movem.l (a7)+, d0-d1/a0
 	rte
 
+/*
+	Sends a byte without the output buffer, for LiveInput.
+	The TX interrupt that follows finds the buffer empty.
+*/
+	.global SccDirectPutByte
+SccDirectPutByte:
+	.func SccDirectPutByte
+1:
+	move.b	0xffff8c85.w, d1
+	jbsr	SccDelay
+	btst	#2, d1				| Transmit buffer empty
+	jeq		1b
+	move.b	7(a7), 0xffff8c87.w
+	jbsr	SccDelay
+	rts
+	.endfunc
+
+	.global SccDirectReady
+SccDirectReady:
+	.func SccDirectReady
+	move.l	d1, -(a7)
+	move.b	0xffff8c85.w, d1
+	jbsr	SccDelay
+	moveq	#0, d0
+	btst	#2, d1				| Transmit buffer empty
+	jeq		1f
+	moveq	#1, d0
+1:
+	move.l	(a7)+, d1
+	rts
+	.endfunc
+
 SccSerialTX:
 	movem.l d0/a0, -(a7)
 	moveq	#0x28, d0
@@ -0,0 +1,106 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+#include <stdbool.h>
+#include "console.h"
+#include "packet.h"
+#include "hex.h"
+
+/*
+	When the ring buffer is full, the oldest output is overwritten and a note about
+	lost output is written first when flushing.
+*/
+#define CONSOLE_BUFFER_SIZE	2048	// Must be a power of 2.
+#define MAX_O_CHARS			((PACKET_SIZE - 20) / 2)
+
+char consoleBuffer[CONSOLE_BUFFER_SIZE];
+unsigned short consoleRead = 0;
+unsigned short consoleWrite = 0;
+bool consoleLost = false;
+
+void ConsolePutChar(char c)
+{
+	consoleBuffer[consoleWrite] = c;
+	consoleWrite = (consoleWrite + 1) & (CONSOLE_BUFFER_SIZE - 1);
+	if (consoleWrite == consoleRead)
+	{
+		consoleRead = (consoleRead + 1) & (CONSOLE_BUFFER_SIZE - 1);
+		consoleLost = true;
+	}
+}
+
+void ConsolePutString(const char* str)
+{
+	char c;
+	while ((c = *str++) != 0)
+	{
+		ConsolePutChar(c);
+	}
+}
+
+void ConsolePutDecimal(unsigned int val)
+{
+	char buf[10];
+	short n = 0;
+	do
+	{
+		buf[n++] = (char)('0' + (val % 10));
+		val /= 10;
+	} while (val != 0);
+	while (n > 0)
+	{
+		ConsolePutChar(buf[--n]);
+	}
+}
+
+void ConsolePutHex(unsigned int val)
+{
+	char buf[8];
+	LongToHex(val, buf);
+	for (short i = 0; i < 8; ++i)
+	{
+		ConsolePutChar(buf[i]);
+	}
+}
+
+bool ConsoleHasOutput(void)
+{
+	return consoleRead != consoleWrite || consoleLost;
+}
+
+void ConsoleDiscard(void)
+{
+	consoleRead = consoleWrite;
+	consoleLost = false;
+}
+
+void ConsoleFlush(void)
+{
+	if (consoleLost)
+	{
+		consoleLost = false;
+		ClearOutPacket();
+		WriteChar('O');
+		const char* lost = "[output lost]\n";
+		char c;
+		while ((c = *lost++) != 0)
+		{
+			WriteByte((unsigned char)c);
+		}
+		TransmitPacket(false);
+	}
+	while (consoleRead != consoleWrite)
+	{
+		ClearOutPacket();
+		WriteChar('O');
+		for (short i = 0; i < MAX_O_CHARS && consoleRead != consoleWrite; ++i)
+		{
+			WriteByte((unsigned char)consoleBuffer[consoleRead]);
+			consoleRead = (consoleRead + 1) & (CONSOLE_BUFFER_SIZE - 1);
+		}
+		TransmitPacket(false);
+	}
+	ClearOutPacket();
+}
@@ -0,0 +1,41 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+/*
+	Text output to the gdb console.
+	Output is buffered in a ring buffer and sent as 'O' packets when gdb is listening,
+	so it can be written from exceptions while the inferior runs.
+*/
+#ifndef CONSOLE_DEFINED
+#define CONSOLE_DEFINED
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void ConsolePutChar(char c);
+void ConsolePutString(const char* str);
+// Writes val as a decimal number.
+void ConsolePutDecimal(unsigned int val);
+// Writes val as 8 hex digits.
+void ConsolePutHex(unsigned int val);
+
+bool ConsoleHasOutput(void);
+void ConsoleDiscard(void);
+
+/*
+	Sends all buffered output as 'O' packets.
+	Only allowed when gdb waits for a stop reply, or for the answer to a qRcmd.
+	The out packet is cleared afterwards.
+*/
+void ConsoleFlush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONSOLE_DEFINED
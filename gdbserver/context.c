@@ -3,6 +3,7 @@
 	SPDX-License-Identifier: MIT
 */
 
+#include <stdbool.h>
 #include "context.h"
 #include "bios_calls.h"
 #include "server.h"
@@ -10,29 +11,94 @@
 #include "critical.h"
 #include "comm.h"
 #include "cookies.h"
+#include "mmu.h"
+#include "live.h"
 
 #define NUM_IRQ_VECTORS 8
 #define NUM_MFP_VECTORS 16
-#define NUM_VDO_LONGS 8
-#define NUM_SYS_LONGS 1
-#define NUM_VDO_BYTES 6
-#define NUM_MFP_BYTES 4
+
+/*
+	Shadowed memory.
+	Every range in shadowRanges is saved when leaving a context and restored when entering it,
+	and gdb accesses to it are redirected to the inferior copy while the server context is in place.
+	The table is sorted on address, for the binary search in InferiorContextMemoryAddress.
+	Registers are stored in the shadow buffers at offset, palettes of different machines share
+	the same space. Vector ranges point into the vector arrays, that are handled on their own.
+
+	To add hardware, add rows. Only registers that the server context changes, or that it wants
+	to have set while it runs, needs to be here. Registers that change by themselves, as the
+	blitter and DMA counters, can't be written back and must be left out.
+	DMA sound is left running while the inferior is stopped, as writing the control register
+	back restarts playback from the frame start, which breaks audio when tracing.
+	The video mode registers of the Falcon are left out, as VIDEL can't be reprogrammed by
+	writing its registers one by one in address order.
+*/
+#define SHADOW_ST			0x01	// Machines, from the _VDO cookie.
+#define SHADOW_STE			0x02
+#define SHADOW_TT			0x04
+#define SHADOW_FALCON		0x08
+#define SHADOW_ALL			0x0f
+#define SHADOW_VECTORS		0x10	// offset is into the vector arrays.
+#define SHADOW_MFP_A		0x20	// Masked with the high byte of mfpMask when restored.
+#define SHADOW_MFP_B		0x40	// Masked with the low byte of mfpMask when restored.
+
+#define SHADOW_SYS			0		// _v_bas_ad
+#define SHADOW_MFP			4		// IERA, IERB, IMRA, IMRB
+#define SHADOW_VDO			8		// Screen base, sync, resolution and scroll bytes.
+#define SHADOW_TT_SHIFT		14
+#define SHADOW_ST_PALETTE	16
+#define SHADOW_PALETTE		48		// TT or Falcon palette.
+#define SHADOW_SIZE			(SHADOW_PALETTE + 0x400)
+
+typedef struct
+{
+	unsigned int	address;
+	unsigned short	length;		// Bytes.
+	unsigned char	width;		// Bytes per access when saved and restored.
+	unsigned char	flags;		// Machines and SHADOW_* flags.
+	unsigned short	offset;		// Into the shadow buffers, or the vector arrays.
+} ShadowRange;
+
+const ShadowRange shadowRanges[] =
+{
+	{0x00000060, 0x20, 4, SHADOW_ALL | SHADOW_VECTORS, 0},
+	{0x00000100, 0x40, 4, SHADOW_ALL | SHADOW_VECTORS, NUM_IRQ_VECTORS * 4},
+	{0x0000044e, 4, 4, SHADOW_ALL, SHADOW_SYS},
+	{0xffff8201, 1, 1, SHADOW_ALL, SHADOW_VDO + 0},
+	{0xffff8203, 1, 1, SHADOW_ALL, SHADOW_VDO + 1},
+	{0xffff820a, 1, 1, SHADOW_ST | SHADOW_STE, SHADOW_VDO + 2},
+	{0xffff820d, 1, 1, SHADOW_STE | SHADOW_TT | SHADOW_FALCON, SHADOW_VDO + 3},
+	{0xffff8240, 0x20, 4, SHADOW_ST | SHADOW_STE, SHADOW_ST_PALETTE},
+	{0xffff8260, 1, 1, SHADOW_ST | SHADOW_STE, SHADOW_VDO + 4},
+	{0xffff8262, 2, 2, SHADOW_TT, SHADOW_TT_SHIFT},
+	{0xffff8265, 1, 1, SHADOW_STE, SHADOW_VDO + 5},
+	{0xffff8400, 0x200, 2, SHADOW_TT, SHADOW_PALETTE},
+	{0xffff9800, 0x400, 4, SHADOW_FALCON, SHADOW_PALETTE},
+	{0xfffffa07, 1, 1, SHADOW_ALL | SHADOW_MFP_A, SHADOW_MFP + 0},
+	{0xfffffa09, 1, 1, SHADOW_ALL | SHADOW_MFP_B, SHADOW_MFP + 1},
+	{0xfffffa13, 1, 1, SHADOW_ALL | SHADOW_MFP_A, SHADOW_MFP + 2},
+	{0xfffffa15, 1, 1, SHADOW_ALL | SHADOW_MFP_B, SHADOW_MFP + 3}
+};
+#define NUM_SHADOW_RANGES	((short)(sizeof(shadowRanges) / sizeof(shadowRanges[0])))
 
 // Server context
 unsigned int serverVectors[NUM_IRQ_VECTORS + NUM_MFP_VECTORS];
-unsigned int serverLongs[NUM_VDO_LONGS + NUM_SYS_LONGS];
-unsigned char serverBytes[NUM_VDO_BYTES + NUM_MFP_BYTES] __attribute__((aligned(2)));
+unsigned char serverShadow[SHADOW_SIZE] __attribute__((aligned(4)));
 
 // Inferior context
 unsigned int inferiorVectors[NUM_IRQ_VECTORS + NUM_MFP_VECTORS];
-unsigned int inferiorLongs[NUM_VDO_LONGS + NUM_SYS_LONGS];
-unsigned char inferiorBytes[NUM_VDO_BYTES + NUM_MFP_BYTES] __attribute__((aligned(2)));
+unsigned char inferiorShadow[SHADOW_SIZE] __attribute__((aligned(4)));
+
+// Caches that must be cleared before the inferior continues.
+unsigned int pendingCacheClear = 0;
+// Set while the inferior context is in place, as when the first stage exception handlers run.
+bool inferiorContextActive = false;
 
 unsigned short GetMfpChangedMask(void);
 void StoreVectors(unsigned int* vectors);
-void RestoreVectors(unsigned int* vectors);
-void StoreMemoryRegisters(unsigned int* longs, unsigned char* bytes);
-void RestoreMemoryRegisters(unsigned int* longs, unsigned char* bytes, unsigned short mfpMask);
+bool RestoreVectors(unsigned int* vectors);
+void StoreMemoryRegisters(unsigned char* shadow);
+void RestoreMemoryRegisters(const unsigned char* shadow, unsigned short mfpMask);
 
 extern comm*	comDev;
 extern char	com_method[];
@@ -47,7 +113,7 @@ int CreateServerContext_super(void)
 	ClearInternalCaches();
     // Store server context.
     StoreVectors(serverVectors);
-    StoreMemoryRegisters(serverLongs, serverBytes);
+    StoreMemoryRegisters(serverShadow);
     return 0;
 }
 
@@ -61,7 +127,7 @@ int DestroyServerContext_super(void)
 {
 	comDev->Exit();
 	RestoreExceptions();
-    RestoreMemoryRegisters(serverLongs, serverBytes, 0xffff);
+    RestoreMemoryRegisters(serverShadow, 0xffff);
 	ClearInternalCaches();
     return 0;
 }
@@ -72,24 +138,57 @@ void DestroyServerContext(void)
 	Supexec(DestroyServerContext_super);
 }
 
+void RequestCacheClear(unsigned int caches)
+{
+	pendingCacheClear |= caches;
+}
+
+void FlushPendingCaches(void)
+{
+	if (pendingCacheClear != 0)
+	{
+		ClearCaches(pendingCacheClear);
+		pendingCacheClear = 0;
+	}
+}
+
+/*
+	Only vectors and registers that differ between the contexts are written,
+	so a trace step in an inferior that haven't touched any of them writes nothing.
+	The caches are only cleared when vectors were changed or the server have
+	written inferior memory.
+*/
 void SwitchToInferiorContext(void)
 {
     // Restore inferior context that was stored in SwitchToServerContext
-    RestoreVectors(inferiorVectors);
-    RestoreMemoryRegisters(inferiorLongs, inferiorBytes, 0xffff);
-	ClearInternalCaches();
+    if (RestoreVectors(inferiorVectors))
+	{
+		pendingCacheClear |= CACHE_DATA;
+	}
+    RestoreMemoryRegisters(inferiorShadow, 0xffff);
+	FlushPendingCaches();
+	MmuApplyProtection(true);
+	inferiorContextActive = true;
 }
 
 void SwitchToServerContext(void)
 {
+	inferiorContextActive = false;
+	// A %Sample notification may be half sent, and the server is about to talk to gdb.
+	LiveSampleFlush();
+	// The server must be able to write to watched inferior memory.
+	MmuApplyProtection(false);
     // Store current inferior context.
     StoreVectors(inferiorVectors);
-    StoreMemoryRegisters(inferiorLongs, inferiorBytes);
+    StoreMemoryRegisters(inferiorShadow);
     // Restore original server context.
 	unsigned short mfpMask = GetMfpChangedMask();
-    RestoreVectors(serverVectors);
-    RestoreMemoryRegisters(serverLongs, serverBytes, mfpMask);
-	ClearInternalCaches();
+    bool vectorsChanged = RestoreVectors(serverVectors);
+    RestoreMemoryRegisters(serverShadow, mfpMask);
+	if (vectorsChanged)
+	{
+		ClearCaches(CACHE_DATA);
+	}
 }
 
 int SetServerContext_super(void)
@@ -103,6 +202,72 @@ void SetServerContext(void)
 	Supexec(SetServerContext_super);
 }
 
+#pragma GCC diagnostic push
+// Remove out of bounds warning, as we do some memory direct stuff here that will trigger false warnings.
+#pragma GCC diagnostic ignored "-Warray-bounds="
+
+/*
+	The inferior vectors and MFP enable/mask bits are written when the inferior context is restored.
+	When the inferior context is active, as in the first stage handlers, they are written directly.
+	IERA/IMRA hold channels 8-15 and IERB/IMRB channels 0-7.
+*/
+void SetInferiorMfpChannel(short channel, unsigned int vector, bool enable)
+{
+	short reg = channel < 8 ? 1 : 0;
+	unsigned char bit = (unsigned char)(1 << (channel & 7));
+	unsigned char* ier;
+	unsigned char* imr;
+	if (inferiorContextActive)
+	{
+		((unsigned int*)0x100)[channel] = vector;
+		ier = (unsigned char*)(0xfffffa07 + reg * 2);
+		imr = (unsigned char*)(0xfffffa13 + reg * 2);
+	}
+	else
+	{
+		inferiorVectors[NUM_IRQ_VECTORS + channel] = vector;
+		ier = &inferiorShadow[SHADOW_MFP + reg];
+		imr = &inferiorShadow[SHADOW_MFP + reg + 2];
+	}
+	if (enable)
+	{
+		*ier |= bit;
+		*imr |= bit;
+	}
+	else
+	{
+		*ier &= (unsigned char)~bit;
+		*imr &= (unsigned char)~bit;
+	}
+}
+
+unsigned int GetInferiorMfpVector(short channel)
+{
+	return inferiorContextActive ? ((unsigned int*)0x100)[channel] : inferiorVectors[NUM_IRQ_VECTORS + channel];
+}
+
+bool ClaimInferiorMfpInterrupt(short channel, void (*handler)(void))
+{
+	unsigned int vector = GetInferiorMfpVector(channel);
+	if (vector != serverVectors[NUM_IRQ_VECTORS + channel] && vector != (unsigned int)handler)
+	{
+		// The inferior have its own handler.
+		return false;
+	}
+	SetInferiorMfpChannel(channel, (unsigned int)handler, true);
+	return true;
+}
+
+void ReleaseInferiorMfpInterrupt(short channel, void (*handler)(void))
+{
+	if (GetInferiorMfpVector(channel) != (unsigned int)handler)
+	{
+		// Replaced by the inferior.
+		return;
+	}
+	SetInferiorMfpChannel(channel, serverVectors[NUM_IRQ_VECTORS + channel], false);
+}
+
 unsigned short GetMfpChangedMask(void)
 {
 	unsigned int* serverMfpVecs = &serverVectors[NUM_IRQ_VECTORS];
@@ -118,10 +283,6 @@ unsigned short GetMfpChangedMask(void)
 	return mask;
 }
 
-#pragma GCC diagnostic push
-// Remove out of bounds warning, as we do some memory direct stuff here that will trigger false warnings.
-#pragma GCC diagnostic ignored "-Warray-bounds="
-
 void StoreVectors(unsigned int* vectors)
 {
 	unsigned int* vector60 = (unsigned int*)0x60;
@@ -136,111 +297,124 @@ void StoreVectors(unsigned int* vectors)
 	}
 }
 
-void RestoreVectors(unsigned int* vectors)
+// Returns true if any vector was changed.
+bool RestoreVectors(unsigned int* vectors)
 {
+	bool changed = false;
 	unsigned int* vector60 = (unsigned int*)0x60;
 	for (int i = 0; i < NUM_IRQ_VECTORS; ++i)
 	{
-		vector60[i] = *vectors++;
+		if (vector60[i] != *vectors)
+		{
+			vector60[i] = *vectors;
+			changed = true;
+		}
+		++vectors;
 	}
 	unsigned int* vector100 = (unsigned int*)0x100;
 	for (int i = 0; i < NUM_MFP_VECTORS; ++i)
 	{
-		vector100[i] = *vectors++;
+		if (vector100[i] != *vectors)
+		{
+			vector100[i] = *vectors;
+			changed = true;
+		}
+		++vectors;
 	}
+	return changed;
 }
 
-void StoreMemoryRegisters(unsigned int* longs, unsigned char* bytes)
+// The machine bit of the video hardware, or 0 if unknown.
+unsigned char ShadowMachine(void)
 {
-	unsigned int* sysLongs = longs;
-	unsigned int* vdoLongs = longs + NUM_SYS_LONGS;
-	unsigned char* vdoChars = bytes;
-	unsigned char* mfpChars = bytes + NUM_VDO_BYTES;
-	#define SYS_LONG(address) *sysLongs++ = *((unsigned int*)address)
-	#define VDO_LONG(address) *vdoLongs++ = *((unsigned int*)address)
-	#define VDO_CHAR(address) *vdoChars++ = *((unsigned char*)address)
-	#define MFP_CHAR(address) *mfpChars++ = *((unsigned char*)address)
-
-	if ((Cookie_MCH >> 16) <= 1)
+	unsigned int vdo = Cookie_VDO >> 16;
+	return vdo <= 3 ? (unsigned char)(1 << vdo) : 0;
+}
+
+void StoreMemoryRegisters(unsigned char* shadow)
+{
+	unsigned char machine = ShadowMachine();
+	for (short i = 0; i < NUM_SHADOW_RANGES; ++i)
 	{
-		// Just handle st/ste shifter for now.
-		// It's really only necessary when we want to display anything in gdbserver... 
-		VDO_CHAR(0xffff8201);
-		VDO_CHAR(0xffff8203);
-		VDO_CHAR(0xffff820a);
-		VDO_CHAR(0xffff8260);
-		if (Cookie_VDO == 0x10000)
+		const ShadowRange* r = &shadowRanges[i];
+		if ((r->flags & SHADOW_VECTORS) != 0 || (r->flags & machine) == 0)
 		{
-			// Got STE shifter
-			VDO_CHAR(0xffff820d);
-			VDO_CHAR(0xffff8265);
+			continue;
 		}
-		for (unsigned int i = 0xffff8240; i < 0xffff8260; i += 4)
+		unsigned char* dst = shadow + r->offset;
+		for (unsigned int a = r->address; a < r->address + r->length; a += r->width, dst += r->width)
 		{
-			VDO_LONG(i);
+			switch (r->width)
+			{
+				case 1:		*dst = *((volatile unsigned char*)a); break;
+				case 2:		*((unsigned short*)dst) = *((volatile unsigned short*)a); break;
+				default:	*((unsigned int*)dst) = *((volatile unsigned int*)a); break;
+			}
 		}
 	}
-	MFP_CHAR(0xfffffa07);
-	MFP_CHAR(0xfffffa09);
-	MFP_CHAR(0xfffffa13);
-	MFP_CHAR(0xfffffa15);
-
-	SYS_LONG(0x44e);
-	
-	#undef SYS_LONG
-	#undef VDO_LONG
-	#undef VDO_CHAR
-	#undef MFP_CHAR
 }
 
-void RestoreMemoryRegisters(unsigned int* longs, unsigned char* bytes, unsigned short mfpMask)
+void RestoreMemoryRegisters(const unsigned char* shadow, unsigned short mfpMask)
 {
-	unsigned int* sysLongs = longs;
-	unsigned int* vdoLongs = longs + NUM_SYS_LONGS;
-	unsigned char* vdoChars = bytes;
-	unsigned char* mfpChars = bytes + NUM_VDO_BYTES;
-	#define SYS_LONG(address) *((unsigned int*)address) = *sysLongs++
-	#define VDO_LONG(address) *((unsigned int*)address) = *vdoLongs++
-	#define VDO_CHAR(address) *((unsigned char*)address) = *vdoChars++
-	#define MFP_CHAR(address, mask) *((unsigned char*)address) = (*mfpChars++) & (unsigned char)(mask)
-
-	if ((Cookie_MCH >> 16) <= 1)
+	unsigned char machine = ShadowMachine();
+	// Only write registers that differ from what is stored.
+	#define WRITE_CHANGED(type, address, value) \
+		{ type v = (value); if (*((volatile type*)address) != v) { *((volatile type*)address) = v; } }
+
+	for (short i = 0; i < NUM_SHADOW_RANGES; ++i)
 	{
-		// Just handle st/ste shifter for now.
-		// It's really only necessary when we want to display anything in gdbserver... 
-		VDO_CHAR(0xffff8201);
-		VDO_CHAR(0xffff8203);
-		VDO_CHAR(0xffff820a);
-		VDO_CHAR(0xffff8260);
-		if (Cookie_VDO == 0x10000)
+		const ShadowRange* r = &shadowRanges[i];
+		if ((r->flags & SHADOW_VECTORS) != 0 || (r->flags & machine) == 0)
+		{
+			continue;
+		}
+		/*
+			mfpMask bits that are 0 should disable mfp interrupts
+			The idea is to disable all mfp interrupts that the inferior have set up.
+			This is necessary as we cannot capture the mfp state and restore it properly.
+		*/
+		unsigned char mask = 0xff;
+		if ((r->flags & SHADOW_MFP_A) != 0)
 		{
-			// Got STE shifter
-			VDO_CHAR(0xffff820d);
-			VDO_CHAR(0xffff8265);
+			mask = (unsigned char)(mfpMask >> 8);
 		}
-		for (unsigned int i = 0xffff8240; i < 0xffff8260; i += 4)
+		else if ((r->flags & SHADOW_MFP_B) != 0)
 		{
-			VDO_LONG(i);
+			mask = (unsigned char)mfpMask;
+		}
+		const unsigned char* src = shadow + r->offset;
+		for (unsigned int a = r->address; a < r->address + r->length; a += r->width, src += r->width)
+		{
+			switch (r->width)
+			{
+				case 1:		WRITE_CHANGED(unsigned char, a, *src & mask); break;
+				case 2:		WRITE_CHANGED(unsigned short, a, *((const unsigned short*)src)); break;
+				default:	WRITE_CHANGED(unsigned int, a, *((const unsigned int*)src)); break;
+			}
 		}
 	}
-	/*
-		mfpMask bits that are 0 should disable mfp interrupts
-		The idea is to disable all mfp interrupts that the inferior have set up.
-		This is necessary as we cannot capture the mfp state and restore it properly.
-	*/
-	MFP_CHAR(0xfffffa07, (mfpMask >> 8));
-	MFP_CHAR(0xfffffa09, (mfpMask));
-	MFP_CHAR(0xfffffa13, (mfpMask >> 8));
-	MFP_CHAR(0xfffffa15, (mfpMask));
-
-	SYS_LONG(0x44e);
-	
-	#undef SYS_LONG
-	#undef VDO_LONG
-	#undef VDO_CHAR
-	#undef MFP_CHAR
+	#undef WRITE_CHANGED
 }
 
+// Returns the first range that ends after la, or NUM_SHADOW_RANGES.
+short FindShadowRange(unsigned int la)
+{
+	short low = 0;
+	short high = NUM_SHADOW_RANGES;
+	while (low < high)
+	{
+		short mid = (short)((low + high) >> 1);
+		if (shadowRanges[mid].address + shadowRanges[mid].length <= la)
+		{
+			low = (short)(mid + 1);
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	return low;
+}
 
 // This method make sure to return a pointer to the data that would have been used by the inferior,
 // and not the one currently used by the server.
@@ -250,65 +424,109 @@ void RestoreMemoryRegisters(unsigned int* longs, unsigned char* bytes, unsigned
 unsigned char* InferiorContextMemoryAddress(unsigned char* address)
 {
 	unsigned int la = (unsigned int)address;
+	if (inferiorContextActive)
+	{
+		// Nothing is shadowed.
+		return address;
+	}
 	if (Cookie_CPU < 20)
 	{
 		// Need to properly set the upper 8 bits.
 		la = (unsigned int)(((int)la << 8) >> 8);
 	}
-	if (la < 0x8000)
+	short i = FindShadowRange(la);
+	if (i == NUM_SHADOW_RANGES)
 	{
-		// 0x0000.w to 0x7fff.w
-		if (la >= 0x60 && la < 0x80)
-		{
-            unsigned char* inferiorVectors60 = (unsigned char*)(inferiorVectors);
-			return &inferiorVectors60[la - 0x60];
-		}
-		else if (la >= 0x100 && la < 0x140)
-		{
-            unsigned char* inferiorVectors100 = (unsigned char*)(inferiorVectors + NUM_IRQ_VECTORS);
-			return &inferiorVectors100[la - 0x100];
-		}
-		else if (la >= 0x44e && la < 0x450)
+		return address;
+	}
+	const ShadowRange* r = &shadowRanges[i];
+	if (la < r->address || (r->flags & ShadowMachine()) == 0)
+	{
+		return address;
+	}
+	unsigned char* shadow = (r->flags & SHADOW_VECTORS) != 0 ? (unsigned char*)inferiorVectors : inferiorShadow;
+	return shadow + r->offset + (la - r->address);
+}
+
+/*
+	Hardware registers are always read and written one byte at a time, as a long access
+	could hit registers that react on reads, or that can't be accessed that way.
+*/
+#define IO_START_24		0x00ff8000
+#define IO_START_32		0xffff8000
+
+unsigned int InferiorContextMemoryBlock(unsigned char* address, unsigned int len)
+{
+	unsigned int la = (unsigned int)address;
+	if (Cookie_CPU < 20)
+	{
+		la = (unsigned int)(((int)la << 8) >> 8);
+	}
+	if ((la >= IO_START_24 && la < 0x01000000) || la >= IO_START_32)
+	{
+		return 0;
+	}
+	unsigned int limit = la < IO_START_24 ? IO_START_24 : IO_START_32;
+	short i = FindShadowRange(la);
+	if (!inferiorContextActive && i < NUM_SHADOW_RANGES && shadowRanges[i].address < limit)
+	{
+		if (la >= shadowRanges[i].address)
 		{
-            unsigned char* inferiorSysLongs = (unsigned char*)(inferiorLongs);
-			return &inferiorSysLongs[la - 0x44e];
+			return 0;
 		}
+		limit = shadowRanges[i].address;
 	}
-	else if (la >= 0xffff8000)
+	return len < limit - la ? len : limit - la;
+}
+
+bool ReadInferiorMemory(unsigned char* address, unsigned char* buf, unsigned int len)
+{
+	bool ok = true;
+	while (len > 0)
 	{
-		// 0xffff8000.w to 0xffffffff.w
-		if ((Cookie_MCH >> 16) <= 1)
+		unsigned int block = InferiorContextMemoryBlock(address, len);
+		if (block == 0 || ExceptionSafeMemoryCopy(buf, address, block) != 0)
 		{
-			// Just handle st/ste shifter for now.
-			// It's really only necessary when we want to display anything in gdbserver... 
-			if (la >= 0xffff8240 && la < 0xffff8260)
+			// Shadowed, hardware or faulting memory, byte by byte.
+			block = block == 0 ? 1 : block;
+			for (unsigned int i = 0; i < block; ++i)
 			{
-				unsigned char* inferiorVdoLongs = (unsigned char*)(inferiorLongs + NUM_SYS_LONGS);
-				return &inferiorVdoLongs[la - 0xffff8240];
+				if (ExceptionSafeMemoryRead(InferiorContextMemoryAddress(address + i), buf + i) != 0)
+				{
+					buf[i] = 0;
+					ok = false;
+				}
 			}
-			else
+		}
+		address += block;
+		buf += block;
+		len -= block;
+	}
+	return ok;
+}
+
+bool WriteInferiorMemory(unsigned char* address, const unsigned char* buf, unsigned int len)
+{
+	bool ok = true;
+	while (len > 0)
+	{
+		unsigned int block = InferiorContextMemoryBlock(address, len);
+		if (block == 0 || ExceptionSafeMemoryCopy(address, buf, block) != 0)
+		{
+			block = block == 0 ? 1 : block;
+			for (unsigned int i = 0; i < block; ++i)
 			{
-				unsigned char* inferiorVdoChars = (inferiorBytes);
-				unsigned char* inferiorMfpChars = &inferiorBytes[NUM_VDO_BYTES];
-				switch (la)
+				if (ExceptionSafeMemoryWrite(InferiorContextMemoryAddress(address + i), buf[i]) != 0)
 				{
-					case 0xffff8201:	return &inferiorVdoChars[0];
-					case 0xffff8203:	return &inferiorVdoChars[1];
-					case 0xffff820a:	return &inferiorVdoChars[2];
-					case 0xffff8260:	return &inferiorVdoChars[3];
-					case 0xffff820d:	return &inferiorVdoChars[4];
-					case 0xffff8265:	return &inferiorVdoChars[5];
-					case 0xfffffa07:	return &inferiorMfpChars[0];
-					case 0xfffffa09:	return &inferiorMfpChars[1];
-					case 0xfffffa11:	return &inferiorMfpChars[2];
-					case 0xfffffa13:	return &inferiorMfpChars[3];
-					default:			return address;
+					ok = false;
 				}
 			}
 		}
+		address += block;
+		buf += block;
+		len -= block;
 	}
-	// Any address not covered by above if's
-	return address;
+	return ok;
 }
 
 #pragma GCC diagnostic pop
@@ -6,6 +6,8 @@
 #ifndef CONTEXT_DEFINED
 #define CONTEXT_DEFINED
 
+#include <stdbool.h>
+
 // Sets up all vectors and registers for running the server.
 int CreateServerContext(void);
 
@@ -24,8 +26,36 @@ void SwitchToServerContext(void);
 // This saves inferior context anyway, as unloaded inferiors might leave garbage that crashes later.
 void SetServerContext(void);
 
+// Makes sure the given CACHE_* caches are cleared before the inferior continues.
+// Must be called whenever the server writes to inferior memory that may be executed.
+void RequestCacheClear(unsigned int caches);
+// Clears the caches requested so far. Used when returning to the inferior without a context switch.
+void FlushPendingCaches(void);
+
+/*
+	Installs handler for an MFP interrupt channel (0-15) in the inferior context, and enables it there.
+	Returns false if the inferior have its own handler.
+*/
+bool ClaimInferiorMfpInterrupt(short channel, void (*handler)(void));
+// Gives the channel back to the server vector, unless the inferior have replaced handler.
+void ReleaseInferiorMfpInterrupt(short channel, void (*handler)(void));
+
 // Returns a pointer to either the same address or a shadow address containing the inferior data.
+// In the inferior context, the address is always returned as is.
 unsigned char* InferiorContextMemoryAddress(unsigned char* address);
+/*
+	Returns how many bytes from address, at most len, that are neither shadowed nor hardware
+	registers, and can be copied as one block. Returns 0 if the first byte must be accessed
+	alone through InferiorContextMemoryAddress.
+*/
+unsigned int InferiorContextMemoryBlock(unsigned char* address, unsigned int len);
+/*
+	Reads or writes inferior memory as the inferior sees it, a block at a time with a single
+	exception guard. A block that faults is done again byte by byte.
+	Returns false if any byte faulted, unreadable bytes are read as 0.
+*/
+bool ReadInferiorMemory(unsigned char* address, unsigned char* buf, unsigned int len);
+bool WriteInferiorMemory(unsigned char* address, const unsigned char* buf, unsigned int len);
 
 
 #endif // CONTEXT_DEFINED
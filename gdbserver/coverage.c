@@ -0,0 +1,246 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+#include <stdbool.h>
+#include "coverage.h"
+#include "exceptions.h"
+#include "critical.h"
+#include "context.h"
+#include "inferior.h"
+#include "file_io.h"
+#include "gdb_defines.h"
+#include "hex.h"
+
+/*
+	The table is kept sorted on offset, so a hit can be found with a binary search.
+	Offsets that already have a breakpoint, or are outside text, are dropped at load.
+*/
+#define NUM_COVERAGE		4096
+#define COVERAGE_READ_SIZE	256
+
+typedef struct
+{
+	unsigned int	offset;		// From the start of the inferior text.
+	unsigned short	store;		// The original instruction.
+} CoveragePoint;
+
+CoveragePoint coverage[NUM_COVERAGE];
+unsigned char coverageHit[NUM_COVERAGE / 8];
+short numCoverage = 0;
+bool coverageActive = false;
+unsigned int coverageText = 0;	// Text start of the inferior the traps are planted in.
+
+bool IsHexChar(char c)
+{
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+void AddOffset(unsigned int* value, short* digits)
+{
+	if (*digits > 0 && numCoverage < NUM_COVERAGE)
+	{
+		coverage[numCoverage++].offset = *value;
+	}
+	*value = 0;
+	*digits = 0;
+}
+
+// Reads the offsets. A "0x" prefix is allowed, anything else that isn't hex separates numbers.
+bool ReadCoverageFile(const char* fileName)
+{
+	int ioErrno;
+	int fd = VfileOpen(fileName, VFILE_O_RDONLY, &ioErrno);
+	if (fd < 0)
+	{
+		return false;
+	}
+	char buf[COVERAGE_READ_SIZE];
+	int pos = 0;
+	int len;
+	unsigned int value = 0;
+	short digits = 0;
+	numCoverage = 0;
+	while ((len = VfileRead(fd, buf, pos, COVERAGE_READ_SIZE, &ioErrno)) > 0)
+	{
+		pos += len;
+		for (int i = 0; i < len; ++i)
+		{
+			char c = buf[i];
+			if ((c == 'x' || c == 'X') && digits == 1 && value == 0)
+			{
+				digits = 0;
+			}
+			else if (IsHexChar(c))
+			{
+				value = (value << 4) | (unsigned int)HexToNibble(c);
+				++digits;
+			}
+			else
+			{
+				AddOffset(&value, &digits);
+			}
+		}
+	}
+	AddOffset(&value, &digits);
+	VfileClose(fd, &ioErrno);
+	return len == 0;
+}
+
+// Shell sort, as the list is often sorted already and we have no qsort.
+void SortCoverage(void)
+{
+	short gap = 1;
+	while (gap < numCoverage / 3)
+	{
+		gap = gap * 3 + 1;
+	}
+	for (; gap > 0; gap = (short)(gap / 3))
+	{
+		for (short i = gap; i < numCoverage; ++i)
+		{
+			unsigned int offset = coverage[i].offset;
+			short j = i;
+			for (; j >= gap && coverage[j - gap].offset > offset; j -= gap)
+			{
+				coverage[j].offset = coverage[j - gap].offset;
+			}
+			coverage[j].offset = offset;
+		}
+	}
+}
+
+short CoverageLoad(const char* fileName)
+{
+	CoverageStop();
+	numCoverage = 0;
+	if (inferiorBasePage == 0 || !ReadCoverageFile(fileName))
+	{
+		numCoverage = 0;
+		return -1;
+	}
+	SortCoverage();
+	coverageText = (unsigned int)inferiorBasePage->p_tbase;
+	unsigned int textLength = inferiorBasePage->p_tlen;
+	short n = 0;
+	for (short i = 0; i < numCoverage; ++i)
+	{
+		unsigned int offset = coverage[i].offset;
+		unsigned short* addr = (unsigned short*)(coverageText + offset);
+		if ((offset & 1) != 0 || offset >= textLength || (n > 0 && coverage[n - 1].offset == offset) ||
+			*addr == BREAKPOINT)
+		{
+			// Drops odd, outside, duplicated and already trapped offsets.
+			continue;
+		}
+		coverage[n].offset = offset;
+		coverage[n].store = *addr;
+		*addr = BREAKPOINT;
+		++n;
+	}
+	numCoverage = n;
+	for (short i = 0; i < NUM_COVERAGE / 8; ++i)
+	{
+		coverageHit[i] = 0;
+	}
+	RequestCacheClear(CACHE_INSTRUCTION);
+	InferiorTextChanged((void*)coverageText, textLength);
+	coverageActive = true;
+	return n;
+}
+
+void CoverageStop(void)
+{
+	if (!coverageActive)
+	{
+		return;
+	}
+	coverageActive = false;
+	for (short i = 0; i < numCoverage; ++i)
+	{
+		unsigned short* addr = (unsigned short*)(coverageText + coverage[i].offset);
+		// A gdb breakpoint on top of the trap restores it when removed, so it is left alone.
+		if (!CoverageIsHit(i) && *addr == BREAKPOINT && IsBreakpoint(addr) < 0)
+		{
+			*addr = coverage[i].store;
+		}
+	}
+	RequestCacheClear(CACHE_INSTRUCTION);
+	// The traps are all in text, which is all that matters.
+	InferiorTextChanged((void*)coverageText, 2);
+}
+
+void CoverageDiscard(void)
+{
+	coverageActive = false;
+	numCoverage = 0;
+}
+
+// Returns the index of the trap at addr, or -1.
+short FindCoverage(unsigned short* addr)
+{
+	if (!coverageActive)
+	{
+		return -1;
+	}
+	unsigned int offset = (unsigned int)addr - coverageText;
+	short low = 0;
+	short high = (short)(numCoverage - 1);
+	while (low <= high)
+	{
+		short mid = (short)((low + high) >> 1);
+		unsigned int o = coverage[mid].offset;
+		if (o < offset)
+		{
+			low = (short)(mid + 1);
+		}
+		else if (o > offset)
+		{
+			high = (short)(mid - 1);
+		}
+		else
+		{
+			return mid;
+		}
+	}
+	return -1;
+}
+
+bool CoverageHit(unsigned short* addr)
+{
+	short idx = FindCoverage(addr);
+	if (idx < 0 || *addr != BREAKPOINT)
+	{
+		// Not our trap, or not anymore.
+		return false;
+	}
+	// Also when already hit, as a gdb breakpoint that was set on top may have put the trap back.
+	*addr = coverage[idx].store;
+	coverageHit[idx >> 3] |= (unsigned char)(1 << (idx & 7));
+	RequestCacheClear(CACHE_INSTRUCTION);
+	InferiorTextChanged(addr, 2);
+	return true;
+}
+
+bool CoverageTake(unsigned short* addr, unsigned short* store)
+{
+	short idx = FindCoverage(addr);
+	if (idx < 0)
+	{
+		return false;
+	}
+	*store = coverage[idx].store;
+	coverageHit[idx >> 3] |= (unsigned char)(1 << (idx & 7));
+	return true;
+}
+
+short CoverageCount(void)
+{
+	return numCoverage;
+}
+
+bool CoverageIsHit(short idx)
+{
+	return (coverageHit[idx >> 3] & (1 << (idx & 7))) != 0;
+}
@@ -0,0 +1,48 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+/*
+	Coverage collection with one-shot breakpoints.
+	A list of text offsets is uploaded with vFile (gdb "remote put"), and a trap #0 is
+	planted at each of them. The first hit restores the original instruction and marks
+	the offset as covered, so the steady state overhead is zero.
+*/
+#ifndef COVERAGE_DEFINED
+#define COVERAGE_DEFINED
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+	Reads hex text offsets, separated by white space, from fileName and plants the traps.
+	Returns the number of planted traps, or -1 on errors.
+*/
+short CoverageLoad(const char* fileName);
+// Removes the traps that haven't been hit. The result is kept until the next load.
+void CoverageStop(void);
+// Forgets everything without touching inferior memory, as the inferior is gone.
+void CoverageDiscard(void);
+
+// Called by the breakpoint exception for unknown traps. Returns true if it was a coverage trap.
+bool CoverageHit(unsigned short* addr);
+/*
+	Called when a breakpoint that saved a coverage trap as its instruction is hit.
+	Marks the offset as covered and writes the original instruction to store.
+	Returns false if addr isn't a coverage offset.
+*/
+bool CoverageTake(unsigned short* addr, unsigned short* store);
+
+// Number of offsets, and if the offset at idx (in ascending order) have been hit.
+short CoverageCount(void);
+bool CoverageIsHit(short idx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COVERAGE_DEFINED
@@ -12,12 +12,32 @@
 int InitExceptions(void);
 int RestoreExceptions(void);
 
+#define CACHE_INSTRUCTION	0x1
+#define CACHE_DATA			0x2
+#define CACHE_ALL			(CACHE_INSTRUCTION | CACHE_DATA)
+
+// Clears all cpu caches.
 void ClearInternalCaches(void);
+// Clears the CACHE_* caches given. Pushes dirty data first on 68040/68060.
+void ClearCaches(unsigned int caches);
+
+// Saves the inferior fpu data and control registers, if not already done during this stop.
+void SaveFpuRegisters(void);
+
+// Writes tc, crp (2 longs), srp (2 longs), tt0 and tt1 to regs. 68030 only.
+void MmuGetRegisters(unsigned int* regs);
+// Flushes the mmu address translation cache. 68030 only.
+void MmuFlush(void);
+
+// Returns a pointer to the stack frame of the current exception. Only valid during the exception.
+unsigned short* GetExceptionFrame(void);
 
 unsigned char CaptureMfpData(unsigned char* address);
 
 int ExceptionSafeMemoryRead(unsigned char* address, unsigned char* c);
 int ExceptionSafeMemoryWrite(unsigned char* address, unsigned char c);
+// Copies len bytes with longs where the alignment allows. Returns 1 if an exception stopped it.
+int ExceptionSafeMemoryCopy(unsigned char* dest, const unsigned char* src, unsigned int len);
 
 // Supervisor mode not needed.
 int GetExceptionNum(void);
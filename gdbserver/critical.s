@@ -11,7 +11,10 @@
 		instructions before usage. Like checking the Cookie_CPU or Cookie_FPU. 
 */
 	.global registers
+	.global registersDirty
+	.global exceptionResume
 	.global Exception
+	.global ResumeSilently
 	.global Cookie_CPU
 	.global Cookie_VDO
 	.global Cookie_FPU
@@ -29,6 +32,9 @@
 
 	.equ	FPU_FRAME_SIZE, 256
 
+	.equ	REGISTERS_DIRTY_FPU, 0x1ffc0000	| Same as in exceptions.h
+	.equ	CACHE_ALL, 0x3				| Same as in critical.h
+
 	.macro HookVector name
 	move.l	n\name, o\name + 2
 	move.l	#\name, n\name
@@ -38,6 +44,10 @@
 	move.l	o\name + 2, n\name
 	.endm
 
+/*
+	If the exception was handled by the server (exceptionResume set), we return to the
+	inferior instead of continuing with the original vector.
+*/
 	.macro Hook name, num
 	.equ	n\name,	\num * 4
 \name:
@@ -46,6 +56,10 @@
 	move.w	#\num, exception_num
 	jsr		HandleException
 	move.l	exception_a7, a7
+	tst.w	exceptionResume
+	jeq		o\name
+	clr.w	exceptionResume
+	rte
 o\name:
 	jmp 	0x12345678
 	.endm
@@ -53,13 +67,13 @@ o\name:
 /*
 	Like Hook, but we do not continue with the original vector.
 */
-	.macro Hijack name, num
+	.macro Hijack name, num, handler=HandleException
 	.equ	n\name,	\num * 4
 \name:
 	ori.w	#0x700, sr
 	move.l	a7, exception_a7
 	move.w	#\num, exception_num
-	jsr		HandleException
+	jsr		\handler
 	move.l	exception_a7, a7
 	rte
 o\name:
@@ -75,9 +89,9 @@ o\name:
 	| Hook CHK, 6
 	Hook TrapV, 7
 	Hook PrivilegeViolation, 8
-	Hijack Trace, 9
+	Hijack Trace, 9, FirstStageException
 	Hook NMI, 31
-	Hijack BreakPoint, 32
+	Hijack BreakPoint, 32, FirstStageException
 
 	Hook FPUnordered, 48
 	Hook FPInexact, 49
@@ -177,6 +191,13 @@ CtrlCException:
 	rte
 	.endfunc
 
+	.global GetExceptionFrame
+GetExceptionFrame:
+	.func GetExceptionFrame
+	move.l	exception_sr_pc, d0
+	rts
+	.endfunc
+
 	.global GetExceptionNum
 GetExceptionNum:
 	.func GetExceptionNum
@@ -195,6 +216,38 @@ HandleException:
 	ori.w	#0x700, sr
 	jmp		RestoreStateAndSwitchContext
 
+/*
+	Breakpoints that never stops and stepping over them happens often, so they are
+	handled here without the full save and context switch.
+	Only the integer registers, sr and pc are saved for ResumeSilently, and only sr and
+	pc are written back. If the server must be entered, we continue with HandleException,
+	which saves everything again.
+*/
+FirstStageException:
+	movem.l	d0-d7/a0-a6, registers
+	jsr		Calc68000Stack
+	move.l	a0, exception_sr_pc
+	move.l	2(a0), registers + o_to_pc
+	moveq	#0, d0
+	move.w	(a0), d0
+	move.l	d0, registers + o_to_sr
+	btst	#13, d0
+	bne.s	1f
+	move.l	usp, a1
+1:
+	move.l	a1, registers + o_to_sp
+	jsr		ResumeSilently
+	tst.b	d0
+	jeq		2f
+	move.l	exception_sr_pc, a0
+	move.w	registers + o_to_sr + 2, (a0)
+	move.l	registers + o_to_pc, 2(a0)
+	movem.l	registers, d0-d7/a0-a6
+	rts
+2:
+	movem.l	registers, d0-d7/a0-a6
+	jra		HandleException
+
 /*
 	Out:
 		a0 = ptr to sr, pc
@@ -225,6 +278,7 @@ Calc68010Stack:
 
 SaveStateAndSwitchContext:
 	movem.l	d0-d7/a0-a6, registers
+	clr.l	registersDirty
 	move.l	Cookie_FPU, d0
 	swap	d0
 	and.w	#0x1f, d0
@@ -244,10 +298,8 @@ SaveStateAndSwitchContext:
 	move.b	1(a0), d0
 	bset	#3, (a0, d0.w)
 3:
-	fmovem.x	fp0-fp7, registers + o_to_fp0
-	fmove.l		fpcr, registers + o_to_fp_control
-	fmove.l		fpsr, registers + o_to_fp_status
-	fmove.l		fpiar, registers + o_to_fp_iaddr
+	| The data and control registers are saved later by SaveFpuRegisters, if anyone asks for them.
+	clr.w	fpu_registers_saved
 	jra		2f
 1:
 	btst	#0, d0
@@ -300,11 +352,27 @@ RestoreStateAndSwitchContext:
     cmp.l   #20, Cookie_CPU
 	jmi		1f
 	| Got fpu and a 020+ cpu
+	| The server never use the fpu, so only reload registers that gdb have written.
+	move.l	internal_fpu_state_frame, a0
+	tst.w	fpu_registers_saved
+	jeq		4f
+	move.l	registersDirty, d1
+	and.l	#REGISTERS_DIRTY_FPU, d1
+	jeq		6f			| Only read, frestore puts a NULL frame fpu back in reset state.
 	fmovem.x	registers + o_to_fp0, fp0-fp7
 	fmove.l		registers + o_to_fp_control, fpcr
 	fmove.l		registers + o_to_fp_status, fpsr
 	fmove.l		registers + o_to_fp_iaddr, fpiar
-	move.l	internal_fpu_state_frame, a0
+4:
+	| A NULL frame means that the fpu is still in reset state, and frestore would only reset it again.
+	moveq	#0, d1
+	btst	#4, d0
+	jeq		5f
+	moveq	#2, d1		| 68060 have the frame format in the third byte.
+5:
+	tst.b	(a0, d1.w)
+	jeq		2f
+6:
 	frestore	(a0)
 	jra		2f
 1:
@@ -316,6 +384,33 @@ RestoreStateAndSwitchContext:
 	movem.l	registers, d0-d7/a0-a6
 	rts
 
+/*
+	The fpu data registers are only saved when they are actually needed.
+	The server never use the fpu, so they are untouched since the exception.
+*/
+	.global SaveFpuRegisters
+SaveFpuRegisters:
+	.func SaveFpuRegisters
+	tst.w	fpu_registers_saved
+	jne		2f
+	move.l	d0, -(a7)
+	move.l	Cookie_FPU, d0
+	swap	d0
+	and.w	#0x1f, d0
+	jeq		1f
+    cmp.l   #20, Cookie_CPU
+	jmi		1f
+	fmovem.x	fp0-fp7, registers + o_to_fp0
+	fmove.l		fpcr, registers + o_to_fp_control
+	fmove.l		fpsr, registers + o_to_fp_status
+	fmove.l		fpiar, registers + o_to_fp_iaddr
+	move.w	#1, fpu_registers_saved
+1:
+	move.l	(a7)+, d0
+2:
+	rts
+	.endfunc
+
 	.global ExceptionSafeMemoryRead
 ExceptionSafeMemoryRead:
 	.func ExceptionSafeMemoryRead
@@ -377,6 +472,63 @@ ExceptionSafeMemoryWrite:
 	rts
 	.endfunc
 
+/*
+	One guard for the whole copy. Longs are only used when source and destination have the
+	same alignment, after a first odd byte.
+*/
+	.global ExceptionSafeMemoryCopy
+ExceptionSafeMemoryCopy:
+	.func ExceptionSafeMemoryCopy
+	movem.l	d1/a0-a1, -(a7)
+	move.w	sr, -(a7)
+	move.l	a7, saved_a7
+	move.l	#1f, nBusError
+	move.l	#1f, nAddressError
+
+	move.l	18(a7), a1		| dest
+	move.l	22(a7), a0		| src
+	move.l	26(a7), d1		| len
+	move.l	a0, d0
+	add.l	a1, d0
+	btst	#0, d0
+	jne		4f				| Different alignment, only bytes.
+	move.l	a0, d0
+	btst	#0, d0
+	jeq		3f
+	tst.l	d1
+	jeq		6f
+	move.b	(a0)+, (a1)+
+	subq.l	#1, d1
+3:
+	move.l	d1, d0
+	lsr.l	#2, d0
+	jeq		4f
+	and.l	#3, d1
+5:
+	move.l	(a0)+, (a1)+
+	subq.l	#1, d0
+	jne		5b
+4:
+	tst.l	d1
+	jeq		6f
+7:
+	move.b	(a0)+, (a1)+
+	subq.l	#1, d1
+	jne		7b
+6:
+	moveq	#0, d0
+	bra.s	2f
+1:
+	move.l	saved_a7, a7
+	moveq	#1, d0
+2:
+	move.l	#BusError, nBusError
+	move.l	#AddressError, nAddressError
+	move.w	(a7)+, sr
+	movem.l	(a7)+, d1/a0-a1
+	rts
+	.endfunc
+
 	.global CaptureMfpData
 CaptureMfpData:
 	.func CaptureMfpData
@@ -400,18 +552,73 @@ CaptureMfpData:
 	.global	ClearInternalCaches
 ClearInternalCaches:
 	.func ClearInternalCaches
+	move.l	#CACHE_ALL, -(a7)
+	jsr		ClearCaches
+	addq.l	#4, a7
+    rts
+	.endfunc
+
+| void ClearCaches(unsigned int caches)
+| 68020/68030: clears the caches through cacr (the 68020 ignores the data cache bit).
+| 68040/68060: the data cache may be in copyback mode, so it must be pushed to memory
+| before the instruction cache is invalidated, or newly written code would not be seen.
+	.global	ClearCaches
+ClearCaches:
+	.func ClearCaches
     cmp.l   #20, Cookie_CPU
-    jmi     1f
-    move.l  d1, -(a7)
+    jmi     4f
+    movem.l d0-d1, -(a7)
+	move.l	12(a7), d0
+    cmp.l   #40, Cookie_CPU
+    jpl     1f
     movec	cacr, d1
+	btst	#0, d0
+	jeq		2f
     bset	#3, d1
+2:
+	btst	#1, d0
+	jeq		3f
     bset	#11, d1
+3:
 	movec	d1, cacr
-    move.l  (a7)+, d1
+	jra		5f
 1:
+	btst	#0, d0
+	jeq		2f
+	.dc.w	0xf4f8				| cpusha bc
+	jra		5f
+2:
+	btst	#1, d0
+	jeq		5f
+	.dc.w	0xf478				| cpusha dc
+5:
+    movem.l (a7)+, d0-d1
+4:
     rts
 	.endfunc
 
+| void MmuGetRegisters(unsigned int* regs)
+| Writes tc, crp, srp, tt0 and tt1 to regs. 68030 only.
+	.global	MmuGetRegisters
+MmuGetRegisters:
+	.func MmuGetRegisters
+	move.l	4(a7), a0
+	pmove	tc, (a0)
+	pmove	crp, 4(a0)
+	pmove	srp, 12(a0)
+	pmove	tt0, 20(a0)
+	pmove	tt1, 24(a0)
+	rts
+	.endfunc
+
+| Flushes the address translation cache after descriptors have been changed. 68030 only.
+	.global	MmuFlush
+MmuFlush:
+	.func MmuFlush
+	pflusha
+	rts
+	.endfunc
+
 	.data
 stackframe_sizes:
 	.dc.w	8, 58, 12, 8
@@ -428,6 +635,7 @@ stackframe_sizes:
 	.lcomm	srvIrqLevel,		2
 	.lcomm	fpucr_save,			4
 	.lcomm	internal_fpu_state_frame, 4
+	.lcomm	fpu_registers_saved, 2
 	.lcomm	internal_fpu_state, FPU_FRAME_SIZE
 	.even
 	
@@ -9,19 +9,82 @@
 #include "server.h"
 #include "critical.h"
 #include "inferior.h"
+#include "context.h"
+#include "mmu.h"
+#include "cookies.h"
+#include "agent.h"
+#include "tracepoint.h"
+#include "coverage.h"
+#include "timing.h"
 
-#define BREAKPOINT	0x4e40		// Trap #0
 #define NUM_MEMPOINTS 128		// Max number of breakpoints handled by this code.
 
 ExceptionRegisters registers;
+unsigned int registersDirty;
+unsigned short exceptionResume;		// Set to return to the inferior from a hooked exception.
 
 typedef struct
 {
 	unsigned short* addr;
 	unsigned short store;
+	unsigned short owners;		// MEMBREAK_* flags, 0 if unused.
+	short condition;			// Agent slot with gdb conditions, or AGENT_NO_SLOT.
+	short commands;				// Agent slot with gdb commands (dprintf), or AGENT_NO_SLOT.
+	short stats;				// Index in breakStats for gdb breakpoints, or -1.
 } MemBreak;
 
+/*
+	Hit counters and ignore counts for gdb breakpoints.
+	gdb removes its breakpoints at every stop, so they are kept by address and survive that.
+*/
+#define NUM_BREAKSTATS	64
+
+typedef struct
+{
+	unsigned short* addr;		// 0 if unused.
+	unsigned int hits;
+	unsigned int ignore;		// Number of hits left to continue silently.
+} BreakStats;
+
+BreakStats breakStats[NUM_BREAKSTATS];
+
 MemBreak mempoints[NUM_MEMPOINTS];
+MemBreak* stepOverBreak = 0;	// Breakpoint temporarily removed to execute the original instruction.
+MemBreak* stoppedAtBreak = 0;	// Breakpoint reported to gdb, its tracepoints are already collected.
+
+void StepOverBreakpoint(MemBreak* mb);
+
+/*
+	Watchpoints are checked by tracing the inferior and comparing the watched memory after
+	each instruction. Only changes can be detected this way, so access watchpoints are
+	reported when the value changes, and read watchpoints are not supported.
+	On the 68030 the watched pages are write protected with the mmu instead when possible,
+	and the inferior runs at full speed until a write to those pages causes a bus error.
+	The faulting write is then rerun without protection and traced, after which the
+	watched memory is compared just like when tracing.
+*/
+#define NUM_WATCHPOINTS		8		// Max number of watchpoints handled by this code.
+#define MAX_WATCH_LENGTH	16		// Max number of bytes watched by a single watchpoint.
+
+typedef struct
+{
+	unsigned char* addr;
+	unsigned short len;				// 0 if unused.
+	unsigned short kind;
+	bool mmu;						// Write protected by the mmu, no need to trace.
+	unsigned char value[MAX_WATCH_LENGTH];
+} WatchPoint;
+
+WatchPoint watchpoints[NUM_WATCHPOINTS];
+short numWatchpoints = 0;
+short numTracedWatchpoints = 0;
+WatchPoint* triggeredWatchpoint = 0;
+bool mmuWatchStep = false;			// Tracing a write that faulted on a protected page.
+
+#define TRACE_GDB		0x1			// gdb have asked for a single step.
+#define TRACE_WATCH		0x2			// Tracing to check watchpoints.
+#define TRACE_STEPOVER	0x4			// Tracing the original instruction of a breakpoint.
+unsigned short traceReasons = 0;
 
 extern void DbgOutVal(const char* name, unsigned int val);
 
@@ -34,15 +97,94 @@ bool IsServerException(void)
 	return textStart <= registers.pc && textEnd > registers.pc;
 }
 
+// Returns the index of the stats for addr, creating them if needed. Returns -1 if the table is full.
+short FindBreakStats(unsigned short* addr)
+{
+	short free = -1;
+	for (short i = 0; i < NUM_BREAKSTATS; ++i)
+	{
+		if (breakStats[i].addr == addr)
+		{
+			return i;
+		}
+		if (free < 0 && breakStats[i].addr == 0)
+		{
+			free = i;
+		}
+	}
+	if (free >= 0)
+	{
+		breakStats[free].addr = addr;
+		breakStats[free].hits = 0;
+		breakStats[free].ignore = 0;
+	}
+	return free;
+}
+
+void ClearBreakpointStats(void)
+{
+	for (short i = 0; i < NUM_BREAKSTATS; ++i)
+	{
+		breakStats[i].addr = 0;
+	}
+	for (short i = 0; i < NUM_MEMPOINTS; ++i)
+	{
+		mempoints[i].stats = -1;
+	}
+}
+
+int SetBreakpointIgnore(unsigned short* addr, unsigned int count)
+{
+	short stats = FindBreakStats(addr);
+	if (stats < 0)
+	{
+		return -1;
+	}
+	breakStats[stats].ignore = count;
+	short idx = IsBreakpoint(addr);
+	if (idx >= 0 && (mempoints[idx].owners & MEMBREAK_GDB) != 0)
+	{
+		mempoints[idx].stats = stats;
+	}
+	return 0;
+}
+
+bool GetBreakpointStats(short idx, unsigned int* addr, unsigned int* hits, unsigned int* ignore)
+{
+	if (idx < 0 || idx >= NUM_BREAKSTATS)
+	{
+		return false;
+	}
+	*addr = (unsigned int)breakStats[idx].addr;
+	*hits = breakStats[idx].hits;
+	*ignore = breakStats[idx].ignore;
+	return true;
+}
+
 void DiscardAllBreakpoints(void)
 {
 	for (int i = 0; i < NUM_MEMPOINTS; ++i)
 	{
 		mempoints[i].addr = 0;
+		mempoints[i].owners = 0;
 	}
+	ClearBreakpointStats();
+	stepOverBreak = 0;
+	stoppedAtBreak = 0;
+	AgentDiscardAll();
+	for (int i = 0; i < NUM_WATCHPOINTS; ++i)
+	{
+		watchpoints[i].len = 0;
+	}
+	numWatchpoints = 0;
+	numTracedWatchpoints = 0;
+	triggeredWatchpoint = 0;
+	mmuWatchStep = false;
+	MmuDiscardAll();
+	CoverageDiscard();
 }
 
-int InsertMemoryBreakpoint(unsigned short* addr)
+int InsertMemoryBreakpoint(unsigned short* addr, unsigned short owner)
 {
 	// Do a sanity check and only allow setting breakpoints in even memory owned by inferior.
 	unsigned int iaddr = (unsigned int)addr;
@@ -52,31 +194,90 @@ int InsertMemoryBreakpoint(unsigned short* addr)
 	{
 		return -1;
 	}
+	short idx = IsBreakpoint(addr);
+	if (idx >= 0)
+	{
+		// Already inserted, gdb does this when conditions change.
+		mempoints[idx].owners |= owner;
+		if ((owner & MEMBREAK_GDB) != 0)
+		{
+			mempoints[idx].stats = FindBreakStats(addr);
+		}
+		return 0;
+	}
 	for (int i = 0; i < NUM_MEMPOINTS; ++i)
 	{
 		if (mempoints[i].addr == 0)
 		{
 			mempoints[i].addr = addr;
+			mempoints[i].owners = owner;
+			mempoints[i].condition = AGENT_NO_SLOT;
+			mempoints[i].commands = AGENT_NO_SLOT;
+			mempoints[i].stats = (owner & MEMBREAK_GDB) != 0 ? FindBreakStats(addr) : -1;
 			mempoints[i].store = *addr;
 			*addr = BREAKPOINT;
+			RequestCacheClear(CACHE_INSTRUCTION);
+			if ((owner & ~MEMBREAK_GDB) != 0)
+			{
+				// gdb knows about its own breakpoints.
+				InferiorTextChanged(addr, 2);
+			}
 			return 0;
 		}
 	}
 	return -1;
 }
 
-int RemoveMemoryBreakpoint(unsigned short* addr)
+int RemoveMemoryBreakpoint(unsigned short* addr, unsigned short owner)
 {
-	for (int i = 0; i < NUM_MEMPOINTS; ++i)
+	short idx = IsBreakpoint(addr);
+	if (idx < 0)
 	{
-		if (mempoints[i].addr == addr)
+		return -1;
+	}
+	MemBreak* mb = &mempoints[idx];
+	mb->owners &= ~owner;
+	if ((owner & MEMBREAK_GDB) != 0)
+	{
+		AgentFreeSlot(mb->condition);
+		AgentFreeSlot(mb->commands);
+		mb->condition = AGENT_NO_SLOT;
+		mb->commands = AGENT_NO_SLOT;
+		mb->stats = -1;
+	}
+	if (mb->owners == 0)
+	{
+		if (stepOverBreak == mb)
 		{
-			mempoints[i].addr = 0;
-			*addr = mempoints[i].store;
-			return 0;
+			// The original instruction is already in place.
+			stepOverBreak = 0;
 		}
+		else
+		{
+			*addr = mb->store;
+			RequestCacheClear(CACHE_INSTRUCTION);
+			if ((owner & ~MEMBREAK_GDB) != 0)
+			{
+				InferiorTextChanged(addr, 2);
+			}
+		}
+		mb->addr = 0;
 	}
-	return -1;
+	return 0;
+}
+
+int SetBreakpointAgent(unsigned short* addr, short condition, short commands)
+{
+	short idx = IsBreakpoint(addr);
+	if (idx < 0)
+	{
+		return -1;
+	}
+	AgentFreeSlot(mempoints[idx].condition);
+	AgentFreeSlot(mempoints[idx].commands);
+	mempoints[idx].condition = condition;
+	mempoints[idx].commands = commands;
+	return 0;
 }
 
 int IsBreakpoint(unsigned short* addr)
@@ -91,6 +292,331 @@ int IsBreakpoint(unsigned short* addr)
 	return -1;
 }
 
+// Reads the watched memory as the inferior sees it. Returns false if the memory can't be read.
+bool ReadWatchedMemory(WatchPoint* wp, unsigned char* buf)
+{
+	for (unsigned short i = 0; i < wp->len; ++i)
+	{
+		if (ExceptionSafeMemoryRead(InferiorContextMemoryAddress(wp->addr + i), buf + i) != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int InsertWatchpoint(unsigned char* addr, unsigned int len, unsigned short kind)
+{
+	if (len == 0 || len > MAX_WATCH_LENGTH || (kind != WATCH_WRITE && kind != WATCH_ACCESS))
+	{
+		return -1;
+	}
+	for (int i = 0; i < NUM_WATCHPOINTS; ++i)
+	{
+		WatchPoint* wp = &watchpoints[i];
+		if (wp->len == 0)
+		{
+			wp->addr = addr;
+			wp->len = (unsigned short)len;
+			wp->kind = kind;
+			if (!ReadWatchedMemory(wp, wp->value))
+			{
+				wp->len = 0;
+				return -1;
+			}
+			wp->mmu = MmuProtectRange(addr, len);
+			if (!wp->mmu)
+			{
+				++numTracedWatchpoints;
+			}
+			++numWatchpoints;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+int RemoveWatchpoint(unsigned char* addr, unsigned int len, unsigned short kind)
+{
+	for (int i = 0; i < NUM_WATCHPOINTS; ++i)
+	{
+		WatchPoint* wp = &watchpoints[i];
+		if (wp->len == len && wp->addr == addr && wp->kind == kind)
+		{
+			if (triggeredWatchpoint == wp)
+			{
+				triggeredWatchpoint = 0;
+			}
+			if (wp->mmu)
+			{
+				MmuUnprotectRange(addr, len);
+			}
+			else
+			{
+				--numTracedWatchpoints;
+			}
+			wp->len = 0;
+			--numWatchpoints;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+unsigned short GetTriggeredWatchpoint(unsigned int* addr)
+{
+	if (triggeredWatchpoint == 0)
+	{
+		return 0;
+	}
+	*addr = (unsigned int)triggeredWatchpoint->addr;
+	return triggeredWatchpoint->kind;
+}
+
+// Returns true if any watched memory have changed, and remembers the first one that did.
+bool CheckWatchpoints(void)
+{
+	unsigned char buf[MAX_WATCH_LENGTH];
+	triggeredWatchpoint = 0;
+	for (int i = 0; i < NUM_WATCHPOINTS; ++i)
+	{
+		WatchPoint* wp = &watchpoints[i];
+		if (wp->len != 0 && ReadWatchedMemory(wp, buf))
+		{
+			bool changed = false;
+			for (unsigned short j = 0; j < wp->len; ++j)
+			{
+				if (wp->value[j] != buf[j])
+				{
+					wp->value[j] = buf[j];
+					changed = true;
+				}
+			}
+			if (changed && triggeredWatchpoint == 0)
+			{
+				triggeredWatchpoint = wp;
+			}
+		}
+	}
+	return triggeredWatchpoint != 0;
+}
+
+void PrepareResume(bool step)
+{
+	// A breakpoint being stepped over must still be inserted again.
+	traceReasons &= TRACE_STEPOVER;
+	if (stoppedAtBreak != 0 && stepOverBreak == 0 && (unsigned int)stoppedAtBreak->addr == registers.pc &&
+		(stoppedAtBreak->owners & (MEMBREAK_TRACE | MEMBREAK_TIME)) != 0)
+	{
+		// Don't collect the tracepoint, or time, twice when gdb continues from its own breakpoint.
+		StepOverBreakpoint(stoppedAtBreak);
+	}
+	stoppedAtBreak = 0;
+	if (step)
+	{
+		traceReasons |= TRACE_GDB;
+	}
+	if (numTracedWatchpoints > 0)
+	{
+		traceReasons |= TRACE_WATCH;
+	}
+	if (numWatchpoints > 0)
+	{
+		// gdb may have written to watched memory during the stop, so start from the current values.
+		for (int i = 0; i < NUM_WATCHPOINTS; ++i)
+		{
+			WatchPoint* wp = &watchpoints[i];
+			if (wp->len != 0)
+			{
+				ReadWatchedMemory(wp, wp->value);
+			}
+		}
+	}
+	triggeredWatchpoint = 0;
+	if (traceReasons != 0)
+	{
+		registers.sr |= 0x8000;
+	}
+	else
+	{
+		registers.sr &= ~0x8000;
+	}
+	registersDirty |= 1 << 16;	// sr
+}
+
+/*
+	Puts the original instruction back and traces it, so the inferior can continue
+	without stopping. The breakpoint is inserted again in the trace exception.
+*/
+void StepOverBreakpoint(MemBreak* mb)
+{
+	if (mb->store == BREAKPOINT && CoverageTake(mb->addr, &mb->store))
+	{
+		// The breakpoint was inserted on a coverage trap, stepping over that would just trap again.
+		InferiorTextChanged(mb->addr, 2);
+	}
+	*mb->addr = mb->store;
+	RequestCacheClear(CACHE_INSTRUCTION);
+	stepOverBreak = mb;
+	traceReasons |= TRACE_STEPOVER;
+	registers.sr |= 0x8000;
+}
+
+// Inserts a stepped over breakpoint again.
+void FinishStepOver(void)
+{
+	if ((traceReasons & TRACE_STEPOVER) != 0)
+	{
+		traceReasons &= ~TRACE_STEPOVER;
+		if (stepOverBreak != 0)
+		{
+			*stepOverBreak->addr = BREAKPOINT;
+			RequestCacheClear(CACHE_INSTRUCTION);
+			stepOverBreak = 0;
+		}
+	}
+}
+
+/*
+	A 68030 bus error from a write to a page protected for a watchpoint.
+	The write is rerun by rte without protection, and traced so the watched memory
+	can be compared, and the protection restored, after the instruction.
+*/
+bool WatchpointWriteFault(void)
+{
+	if (Cookie_CPU != 30)
+	{
+		return false;
+	}
+	unsigned short* frame = GetExceptionFrame();
+	unsigned short format = frame[3] >> 12;
+	unsigned short ssw = frame[5];
+	unsigned int faultAddr = *((unsigned int*)(frame + 8));
+	// Data fault (DF) on a write (RW clear) in short or long bus fault frame.
+	if ((format != 0xa && format != 0xb) || (ssw & 0x100) == 0 || (ssw & 0x40) != 0 ||
+		!MmuIsProtected(faultAddr))
+	{
+		return false;
+	}
+	MmuSuspendProtection();
+	mmuWatchStep = true;
+	registers.sr |= 0x8000;
+	exceptionResume = 1;
+	return true;
+}
+
+/*
+	Handles tracepoints, conditions and commands of a hit breakpoint. registers.pc must point to the breakpoint.
+	Returns true if the inferior should continue without stopping.
+*/
+bool ContinueFromBreakpoint(MemBreak* mb)
+{
+	if ((mb->owners & MEMBREAK_TIME) != 0)
+	{
+		TimeHit(mb->addr);
+	}
+	if ((mb->owners & MEMBREAK_TRACE) != 0)
+	{
+		TraceHit(mb->addr);
+	}
+	if ((mb->owners & (MEMBREAK_TRACE | MEMBREAK_TIME)) != 0)
+	{
+		/*
+			Tracing and timing stops when done, which removes the breakpoint and frees the slot,
+			so mb->addr is 0 then. The original instruction is back, so just resume.
+		*/
+		if (mb->owners == 0)
+		{
+			return true;
+		}
+		if ((mb->owners & ~(MEMBREAK_TRACE | MEMBREAK_TIME)) == 0)
+		{
+			StepOverBreakpoint(mb);
+			return true;
+		}
+	}
+	if (!AgentConditionTrue(mb->condition))
+	{
+		// Condition evaluated on target to false, continue without telling gdb.
+		StepOverBreakpoint(mb);
+		return true;
+	}
+	if (mb->stats >= 0)
+	{
+		BreakStats* bs = &breakStats[mb->stats];
+		++bs->hits;
+		if (bs->ignore != 0)
+		{
+			// Ignored hits are counted, but never reach gdb.
+			--bs->ignore;
+			StepOverBreakpoint(mb);
+			return true;
+		}
+	}
+	if (mb->commands != AGENT_NO_SLOT)
+	{
+		// Breakpoints with commands (dprintf) never stops, output is buffered until next stop.
+		AgentRunCommands(mb->commands);
+		StepOverBreakpoint(mb);
+		return true;
+	}
+	stoppedAtBreak = mb;
+	return false;
+}
+
+/*
+	Called from the first stage trace and breakpoint handlers in critical.s, still in the inferior
+	context and with only d0-a7, sr and pc saved. Handles the breakpoints that never stops, and the
+	trace after stepping over one, so they cost no context switch.
+	Returns true if the inferior should continue, otherwise HandleException and Exception() follows.
+*/
+bool ResumeSilently(void)
+{
+	if (mmuWatchStep)
+	{
+		return false;
+	}
+	bool resume = false;
+	// Breakpoints may share pages with watched memory.
+	MmuApplyProtection(false);
+	if (GetExceptionNum() == 9)
+	{
+		if (IsServerException())
+		{
+			// See Exception().
+			FinishStepOver();
+			resume = true;
+		}
+		else if (traceReasons == TRACE_STEPOVER)
+		{
+			FinishStepOver();
+			registers.sr &= ~0x8000;
+			resume = true;
+		}
+	}
+	else
+	{
+		short idx = IsBreakpoint((unsigned short*)(registers.pc - 2));
+		if (idx >= 0)
+		{
+			registers.pc -= 2;
+			resume = ContinueFromBreakpoint(&mempoints[idx]);
+		}
+		else if (CoverageHit((unsigned short*)(registers.pc - 2)))
+		{
+			// The original instruction is back in place.
+			registers.pc -= 2;
+			resume = true;
+		}
+	}
+	MmuApplyProtection(true);
+	if (resume)
+	{
+		FlushPendingCaches();
+	}
+	return resume;
+}
+
 void Exception(void)
 {
 	int si_signo = GDB_SIGINT;
@@ -98,6 +624,10 @@ void Exception(void)
 	switch (GetExceptionNum())
 	{
 		case 2:		// BusError
+			if (WatchpointWriteFault())
+			{
+				return;
+			}
 			si_signo = GDB_SIGBUS;
 			si_code = BUS_ADRALN;
 			break;
@@ -128,8 +658,39 @@ void Exception(void)
 			si_code = ILL_PRVOPC;
 			break;
 		case 9:		// Trace
-			si_signo = GDB_SIGTRAP;
-			si_code = TRAP_TRACE;
+			{
+				si_signo = GDB_SIGTRAP;
+				si_code = TRAP_TRACE;
+				FinishStepOver();
+				if (IsServerException())
+				{
+					/*
+						A traced trap #0 is traced into our own BreakPoint handler before it runs.
+						Let it run, it will stop if needed.
+					*/
+					return;
+				}
+				bool watchStep = mmuWatchStep;
+				if (watchStep)
+				{
+					// The faulted write is done, and the protection is restored when we return.
+					mmuWatchStep = false;
+				}
+				if (traceReasons == 0)
+				{
+					// Nothing more to trace for, stepping over a breakpoint or a faulted write is done.
+					registers.sr &= ~0x8000;
+				}
+				if ((watchStep || (traceReasons & TRACE_WATCH) != 0) && CheckWatchpoints())
+				{
+					si_code = TRAP_WATCH;
+				}
+				else if ((traceReasons & TRACE_GDB) == 0)
+				{
+					// Only tracing for the watchpoints, and nothing have changed.
+					return;
+				}
+			}
 			break;
 		case 31:	// NMI
 			si_signo = GDB_SIGBUS;
@@ -152,6 +713,7 @@ void Exception(void)
 				*/
 				if (IsBreakpoint((unsigned short*)(registers.pc - 2)) >= 0)
 				{
+					// Conditions, commands and tracepoints have already been handled by ResumeSilently.
 					registers.pc -= 2;
 				}
 				
@@ -192,12 +754,17 @@ void Exception(void)
 		case 1000:	// CtrlCException
 			si_signo = GDB_SIGINT;
 			si_code = 0;
+			if (NonStopPacket(&si_signo))
+			{
+				return;
+			}
 			break;
 		default:	// Anything else.
 			si_signo = GDB_SIGINT;
 			si_code = 0;
 			break;
 	}
+	TimeAbortPass();
 	ServerCommandLoop(si_signo, si_code);
 }
 
@@ -22,13 +22,49 @@ typedef struct
 	unsigned int	fpControl, fpStatus, fpIAddr;
 } ExceptionRegisters;
 
+/*
+	One bit per gdb register number, set when gdb writes a register during a stop.
+	Cleared on every exception entry, and used by critical.s to skip reloading
+	the fpu when gdb have not touched any fpu register.
+*/
+#define REGISTERS_DIRTY_FPU	0x1ffc0000	// gdb registers 18 - 28
+extern unsigned int registersDirty;
+
+#define WATCH_WRITE		2	// Same as the gdb Z packet types.
+#define WATCH_READ		3
+#define WATCH_ACCESS	4
+
 void Exception(void);
+// First stage for trace and breakpoint exceptions, returns true if the inferior can continue without a context switch.
+bool ResumeSilently(void);
 void DiscardAllBreakpoints(void);
 
 bool IsServerException(void);
-int InsertMemoryBreakpoint(unsigned short* addr);
-int RemoveMemoryBreakpoint(unsigned short* addr);
+#define BREAKPOINT		0x4e40	// Trap #0
+#define MEMBREAK_GDB	0x1		// Breakpoint owners, a breakpoint is removed when it has no owner.
+#define MEMBREAK_START	0x2
+#define MEMBREAK_TRACE	0x4
+#define MEMBREAK_TIME	0x8
+
+int InsertMemoryBreakpoint(unsigned short* addr, unsigned short owner);
+int RemoveMemoryBreakpoint(unsigned short* addr, unsigned short owner);
+// Sets the agent slots with conditions and commands for a breakpoint. Any previous slots are freed.
+int SetBreakpointAgent(unsigned short* addr, short condition, short commands);
 int IsBreakpoint(unsigned short* addr);
+/*
+	Hit counters and ignore counts for gdb breakpoints, kept by address until gdb disconnects.
+	An ignore count can be set before the breakpoint is inserted.
+*/
+int SetBreakpointIgnore(unsigned short* addr, unsigned int count);
+// Returns false when idx is past the end of the table. addr is 0 for unused entries.
+bool GetBreakpointStats(short idx, unsigned int* addr, unsigned int* hits, unsigned int* ignore);
+void ClearBreakpointStats(void);
+int InsertWatchpoint(unsigned char* addr, unsigned int len, unsigned short kind);
+int RemoveWatchpoint(unsigned char* addr, unsigned int len, unsigned short kind);
+// Returns the kind of the watchpoint that caused the last stop, or 0 if none did.
+unsigned short GetTriggeredWatchpoint(unsigned int* addr);
+// Sets the trace bit as needed by gdb single step and by watchpoints.
+void PrepareResume(bool step);
 ExceptionRegisters* GetRegisters(void);
 
 #ifdef __cplusplus
@@ -8,6 +8,7 @@
 #include "bios_calls.h"
 #include "file_io.h"
 #include "clib.h"
+#include "inferior.h"
 
 #define NUM_HANDLES 8
 int fd_handles[NUM_HANDLES];
@@ -102,6 +103,16 @@ int VfileOpen(const char *fileName, int flags, int *ioErrno)
 	bool excl = (flags & VFILE_O_EXCL) != 0;
 	bool trunc = (flags & VFILE_O_TRUNC) != 0;
 
+	if (IsRamFileName(fileName))
+	{
+		return RamFileOpen(ioErrno);
+	}
+	if (bios_mode != VFILE_O_RDONLY || create || trunc)
+	{
+		// May be the cached inferior.
+		InferiorCacheInvalidate();
+	}
+
 	if (!trunc)
 	{
 		fd = Fopen(fileName, bios_mode);
@@ -152,6 +163,10 @@ int VfileOpen(const char *fileName, int flags, int *ioErrno)
 
 int VfileClose(int fd, int *ioErrno)
 {
+	if (fd == RAM_FILE_FD)
+	{
+		return RamFileClose(ioErrno);
+	}
 	int result = Fclose((unsigned short)fd);
 	if (result < 0)
 	{
@@ -167,6 +182,7 @@ int VfileClose(int fd, int *ioErrno)
 
 int VfileDelete(const char *fileName, int *ioErrno)
 {
+	InferiorCacheInvalidate();
 	int result = Fdelete(fileName);
 	if (result < 0)
 	{
@@ -179,6 +195,10 @@ int VfileDelete(const char *fileName, int *ioErrno)
 int VfileWrite(int fd, const void *buf, int offset, int nbytes, int *ioErrno)
 {
 	int numWritten = -1;
+	if (fd == RAM_FILE_FD)
+	{
+		return RamFileWrite(buf, offset, nbytes, ioErrno);
+	}
 	if (IsHandle(fd) == 0)
 	{
 		if (offset > 0)
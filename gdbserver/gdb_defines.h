@@ -85,6 +85,10 @@
 #define FPE_FLTINV  14
 #endif
 
+#ifndef TRAP_WATCH
+#define TRAP_WATCH  15
+#endif
+
 // Responses for file operations
 #define VFILE_ERRNO_EPERM           1
 #define VFILE_ERRNO_ENOENT          2
@@ -29,6 +29,16 @@ unsigned int HexToLong(char* ptr)
 	return val;
 }
 
+// Endian aware, writes 8 hex digits without terminating zero.
+void LongToHex(unsigned int val, char* ptr)
+{
+	for (int i = 7; i >= 0; --i)
+	{
+		ptr[i] = NibbleToHex(val);
+		val >>= 4;
+	}
+}
+
 int HexConvertByteArray(char *hexArray)
 {
 	// To save memory, we just convert the array in the same buffer.
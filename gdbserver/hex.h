@@ -13,6 +13,7 @@ extern const char hex[];
 int HexToNibble(char c);
 unsigned char HexToByte(char* ptr);
 unsigned int HexToLong(char* ptr);
+void LongToHex(unsigned int val, char* ptr);
 int HexConvertByteArray(char *hexArray);
 int HexToVariable(char* ptr);
 
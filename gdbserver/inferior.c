@@ -6,13 +6,18 @@
 #include "bios_calls.h"
 #include "exceptions.h"
 #include "log.h"
+#include "clib.h"
+#include "critical.h"
 
 #define MINTELF_RESERVED 0x454c4628
 #define M68K_ATARI_ELF_RESERVED 0x68e1f001	// 68e1f = haxxor 68elf. 001 is version number.
 
 struct BasePage*	inferiorBasePage = NULL;		// basepage for debugged exectable
 InferiorState		inferiorState = NOT_LOADED;		// To know if we have an inferior and if we have started it or not.
-bool				inferior_is_mintelf = false;	// If set then the inferior loaded is of mintelf executable format.
+PrgHeader			inferiorHeader;					// Header of the loaded inferior, valid while inferiorBasePage is set.
+InferiorToolchain	inferiorToolchain = TOOLCHAIN_UNKNOWN;	// Toolchain that linked the loaded inferior.
+unsigned int		inferiorTextChanges = 0;		// Counts server writes to the inferior text.
+unsigned int		reportedTextChanges = 0;		// inferiorTextChanges at the last stop reply.
 
 bool inferiorTerminatedByServer = false;
 unsigned short* __start_Breakpoint = NULL;			// Only set during startup of inferior, and used to break at __start.
@@ -20,19 +25,477 @@ char	inferior_filename[MAX_PATH_LEN] __attribute__((aligned(2)));	// The filenam
 char	inferior_cmdline[MAX_PATH_LEN] __attribute__((aligned(2)));		// Command line args to debugged inferior.
 char	inferior_workpath[MAX_PATH_LEN] __attribute__((aligned(2)));	// The work path of the inferior being debugged. Can be empty if nothing is loaded.
 
-bool CheckIfMintElf(const char* fileName)
+/*
+	RAM: files.
+	A file named "RAM:something" is written directly into a basepage created with PE_BASEPAGE,
+	instead of to disk. The file is laid out as on disk after the 256 byte basepage, except for
+	the header that is kept aside. When closed, the image is relocated, bss is cleared and the
+	basepage is filled in, so vRun can start it without any disk I/O.
+	There is only one RAM image, and vRun with any RAM: name uses it.
+*/
+struct BasePage*	ramBasePage = NULL;
+PrgHeader			ramHeader;
+unsigned int		ramLength = 0;		// Length of the file written so far.
+bool				ramReady = false;	// Closed and relocated.
+
+/*
+	Image cache.
+	When memory allows, a copy of the relocated text and data, and the fixup table, is kept
+	after a load. Loading the same file again copies it into a new basepage instead of reading
+	the disk, and relocates it again if the basepage ended up somewhere else.
+	The cache is dropped when the server writes or deletes any file, and a disk file is checked
+	against its size and time in the directory.
+*/
+#define CACHE_INFERIOR_MARGIN	0x10000		// Free memory the inferior must still have, above text, data and bss.
+
+typedef struct
+{
+	char			name[MAX_PATH_LEN];		// Empty when nothing is cached.
+	PrgHeader		header;
+	unsigned int	fileLength;
+	unsigned short	time;
+	unsigned short	date;
+	unsigned char*	text;					// Where the copy is relocated to.
+	unsigned char*	image;					// Text, data and fixups.
+	unsigned int	fixupLength;
+} ImageCache;
+
+ImageCache imageCache = {{0}, {0}, 0, 0, 0, NULL, NULL, 0};
+
+bool IsRamFileName(const char* fileName)
+{
+	return StringCompare("RAM:", fileName) > 0;
+}
+
+bool IsSameName(const char* a, const char* b)
+{
+	short len = StringCompare(a, b);
+	return len >= 0 && b[len] == 0;
+}
+
+/*
+	Checks the header against the length of the whole file. Text and data must be in the file,
+	while symbols and fixups may be cut short, as RelocateImage checks the fixups.
+	Empty and truncated files, and anything that isn't a program, fail here.
+*/
+bool ValidPrgHeader(const PrgHeader* h, unsigned int fileLength)
+{
+	if (fileLength < PRG_HEADER_SIZE || h->magic != PRG_MAGIC)
+	{
+		return false;
+	}
+	if (h->tlen == 0 || (h->tlen & 1) != 0 || h->tlen > PRG_MAX_SEGMENT || h->dlen > PRG_MAX_SEGMENT ||
+		h->blen > PRG_MAX_SEGMENT || h->slen > PRG_MAX_SEGMENT)
+	{
+		// No code to start, or sizes that can't be from a real program.
+		return false;
+	}
+	return fileLength - PRG_HEADER_SIZE >= h->tlen + h->dlen + h->slen;
+}
+
+// Remembers the header of the inferior about to be started.
+void SetInferiorHeader(const PrgHeader* h)
+{
+	inferiorHeader = *h;
+	++inferiorTextChanges;
+	if (h->reserved == MINTELF_RESERVED)
+	{
+		inferiorToolchain = TOOLCHAIN_MINTELF;
+		DbgOut("mintelf, ");
+	}
+	else if (h->reserved == M68K_ATARI_ELF_RESERVED)
+	{
+		inferiorToolchain = TOOLCHAIN_ATARI_ELF;
+		DbgOut("m68k-atari-elf, ");
+	}
+	else
+	{
+		inferiorToolchain = TOOLCHAIN_UNKNOWN;
+	}
+}
+
+/*
+	The fixup table starts with the offset of the first long to relocate, or 0 if none.
+	Then comes a byte per long, with the distance to the next, 1 for 254 without relocation, and 0 at the end.
+	delta is added to every long, which is the text address for a freshly read image.
+*/
+bool RelocateImage(unsigned char* text, const PrgHeader* header, const unsigned char* fixup,
+	const unsigned char* fixupEnd, unsigned int delta)
+{
+	if (header->absflag != 0 || delta == 0)
+	{
+		return true;
+	}
+	if (fixup + 4 > fixupEnd)
+	{
+		return false;
+	}
+	unsigned int first = ((unsigned int)fixup[0] << 24) | ((unsigned int)fixup[1] << 16) |
+		((unsigned int)fixup[2] << 8) | fixup[3];
+	fixup += 4;
+	if (first == 0)
+	{
+		return true;
+	}
+	unsigned char* dataEnd = text + header->tlen + header->dlen;
+	unsigned char* addr = text + first;
+	while (true)
+	{
+		if (((unsigned int)addr & 1) != 0 || addr + 4 > dataEnd)
+		{
+			return false;
+		}
+		*((unsigned int*)addr) += delta;
+		unsigned char c;
+		do
+		{
+			if (fixup >= fixupEnd)
+			{
+				return false;
+			}
+			c = *fixup++;
+			if (c == 1)
+			{
+				addr += 254;
+			}
+		} while (c == 1);
+		if (c == 0)
+		{
+			return true;
+		}
+		addr += c;
+	}
+}
+
+// Clears bss, and the rest of the TPA unless fast load is set, and fills in the basepage, for an image placed right after it.
+void SetupBasePage(struct BasePage* bp, const PrgHeader* h)
+{
+	unsigned char* text = (unsigned char*)(bp + 1);
+	unsigned char* bss = text + h->tlen + h->dlen;
+	if ((h->prgflags & PRGFLAG_FASTLOAD) != 0)
+	{
+		memset(bss, 0, h->blen);
+	}
+	else
+	{
+		memset(bss, 0, (size_t)(bp->p_hitpa - bss));
+	}
+	bp->p_tbase = text;
+	bp->p_tlen = h->tlen;
+	bp->p_dbase = text + h->tlen;
+	bp->p_dlen = h->dlen;
+	bp->p_bbase = text + h->tlen + h->dlen;
+	bp->p_blen = h->blen;
+}
+
+int ClearCaches_super(void)
+{
+	ClearInternalCaches();
+	return 0;
+}
+
+void InferiorCacheInvalidate(void)
+{
+	if (imageCache.image != NULL)
+	{
+		Mfree(imageCache.image);
+		imageCache.image = NULL;
+	}
+	imageCache.name[0] = 0;
+}
+
+// Allocates the cache, if reserve bytes are still free after it for the inferior.
+bool CacheAllocate(const PrgHeader* h, unsigned int fixupLength, unsigned int reserve)
+{
+	InferiorCacheInvalidate();
+	unsigned int imageLength = h->tlen + h->dlen;
+	unsigned char* image = Malloc((int)(imageLength + fixupLength));
+	if (image == NULL)
+	{
+		return false;
+	}
+	if ((unsigned int)Malloc(-1) < reserve)
+	{
+		Mfree(image);
+		return false;
+	}
+	imageCache.image = image;
+	imageCache.header = *h;
+	imageCache.fixupLength = fixupLength;
+	return true;
+}
+
+// Copies the freshly loaded text and data. The fixups must already be in place.
+void CacheStore(const char* fileName, const struct BasePage* bp)
+{
+	memcpy(imageCache.image, bp->p_tbase, imageCache.header.tlen + imageCache.header.dlen);
+	imageCache.text = bp->p_tbase;
+	StrCopy(fileName, imageCache.name);
+}
+
+bool CacheValid(const char* fileName)
+{
+	if (IsRamFileName(fileName))
+	{
+		return IsRamFileName(imageCache.name);
+	}
+	if (imageCache.name[0] == 0 || !IsSameName(imageCache.name, fileName))
+	{
+		return false;
+	}
+	struct DTA* dta = Fgetdta(0);
+	return Fsfirst(fileName, 0) == 0 && dta->d_length == imageCache.fileLength &&
+		dta->d_time == imageCache.time && dta->d_date == imageCache.date;
+}
+
+/*
+	Creates a basepage for the program, in TT RAM when its flags allow it, as Pexec(PE_LOAD)
+	would have. GEMDOS before 0.19 has no PE_CBASEPAGE, and only ST RAM anyway.
+	Returns the basepage, or a negative GEMDOS error.
+*/
+int CreateBasePage(const PrgHeader* h, const char* cmdLine, const char* environment)
+{
+	const char emptyCmdLine[2] = {0, 0};
+	if (cmdLine == NULL)
+	{
+		cmdLine = emptyCmdLine;
+	}
+	unsigned short version = Sversion();
+	if (((version & 0xff) << 8 | (version >> 8)) >= 0x0019)
+	{
+		return Pexec(PE_CBASEPAGE, (const char*)h->prgflags, cmdLine, environment);
+	}
+	return Pexec(PE_BASEPAGE, 0, cmdLine, environment);
+}
+
+// Returns the basepage, or a negative GEMDOS error.
+int CacheLoad(const char* cmdLine, const char* environment)
+{
+	const PrgHeader* h = &imageCache.header;
+	unsigned int imageLength = h->tlen + h->dlen;
+	int res = CreateBasePage(h, cmdLine, environment);
+	if (res <= 0)
+	{
+		return res;
+	}
+	struct BasePage* bp = (struct BasePage*)res;
+	unsigned char* text = (unsigned char*)(bp + 1);
+	if (text + imageLength + h->blen > bp->p_hitpa)
+	{
+		Mfree(bp->p_env);
+		Mfree(bp);
+		return -39;		// Insufficient memory
+	}
+	memcpy(text, imageCache.image, imageLength);
+	unsigned char* fixup = imageCache.image + imageLength;
+	RelocateImage(text, h, fixup, fixup + imageCache.fixupLength, (unsigned int)text - (unsigned int)imageCache.text);
+	SetupBasePage(bp, h);
+	Supexec(ClearCaches_super);
+	SetInferiorHeader(h);
+	return res;
+}
+
+void RamFileDiscard(void)
+{
+	if (ramBasePage != NULL)
+	{
+		Mfree(ramBasePage->p_env);
+		Mfree(ramBasePage);
+		ramBasePage = NULL;
+	}
+	ramReady = false;
+}
+
+int RamFileOpen(int* ioErrno)
+{
+	RamFileDiscard();
+	InferiorCacheInvalidate();
+	const char emptyCmdLine[2] = {0, 0};
+	int res = Pexec(PE_BASEPAGE, 0, emptyCmdLine, NULL);
+	if (res <= 0)
+	{
+		*ioErrno = VFILE_ERRNO_ENOSPC;
+		return -1;
+	}
+	ramBasePage = (struct BasePage*)res;
+	ramLength = 0;
+	return RAM_FILE_FD;
+}
+
+int RamFileWrite(const void* buf, int offset, int nbytes, int* ioErrno)
+{
+	if (ramBasePage == NULL || ramReady || offset < 0 || nbytes < 0)
+	{
+		*ioErrno = VFILE_ERRNO_EBADF;
+		return -1;
+	}
+	const unsigned char* src = buf;
+	unsigned int pos = (unsigned int)offset;
+	unsigned int end = pos + (unsigned int)nbytes;
+	unsigned char* image = (unsigned char*)(ramBasePage + 1);
+	if (image + (end > PRG_HEADER_SIZE ? end - PRG_HEADER_SIZE : 0) > ramBasePage->p_hitpa)
+	{
+		*ioErrno = VFILE_ERRNO_ENOSPC;
+		return -1;
+	}
+	for (; pos < end && pos < PRG_HEADER_SIZE; ++pos)
+	{
+		((unsigned char*)&ramHeader)[pos] = *src++;
+	}
+	if (pos < end)
+	{
+		memcpy(image + pos - PRG_HEADER_SIZE, src, end - pos);
+	}
+	if (end > ramLength)
+	{
+		ramLength = end;
+	}
+	return nbytes;
+}
+
+int RamFileClose(int* ioErrno)
+{
+	if (ramBasePage == NULL || ramReady)
+	{
+		*ioErrno = VFILE_ERRNO_EBADF;
+		return -1;
+	}
+	unsigned char* text = (unsigned char*)(ramBasePage + 1);
+	const PrgHeader* h = &ramHeader;
+	unsigned int imageLength = h->tlen + h->dlen;
+	unsigned char* fixup = text + imageLength + h->slen;
+	unsigned char* fileEnd = text + ramLength - PRG_HEADER_SIZE;
+	if (!ValidPrgHeader(h, ramLength) ||
+		text + imageLength + h->blen > ramBasePage->p_hitpa ||
+		!RelocateImage(text, h, fixup, fileEnd, (unsigned int)text))
+	{
+		RamFileDiscard();
+		*ioErrno = VFILE_ERRNO_EINVAL;
+		return -1;
+	}
+	// The bss overlaps the symbols and fixups, so they are cached before it is cleared.
+	unsigned int fixupLength = (unsigned int)(fileEnd - fixup);
+	if (CacheAllocate(h, fixupLength, 0))
+	{
+		memcpy(imageCache.image + imageLength, fixup, fixupLength);
+	}
+	SetupBasePage(ramBasePage, h);
+	if (imageCache.image != NULL)
+	{
+		CacheStore("RAM:", ramBasePage);
+	}
+	Supexec(ClearCaches_super);
+	ramReady = true;
+	return 0;
+}
+
+// Hands the RAM image over to the inferior. Returns the basepage, or a negative GEMDOS error.
+int RamFileTake(const char* cmdLine)
+{
+	if (!ramReady)
+	{
+		return -33;		// File not found
+	}
+	struct BasePage* bp = ramBasePage;
+	ramBasePage = NULL;
+	ramReady = false;
+	if (cmdLine != NULL)
+	{
+		short len = (short)(unsigned char)cmdLine[0];
+		if (len > 125)
+		{
+			len = 125;
+		}
+		memcpy(bp->p_cmdlin, cmdLine, (size_t)len + 1);
+		bp->p_cmdlin[len + 1] = 0;
+	}
+	SetInferiorHeader(&ramHeader);
+	return (int)bp;
+}
+
+/*
+	Loads a disk program into a new basepage, opening the file once.
+	The fixups are read into the cache, or into the TPA above data when there is no cache,
+	where bss later is cleared. Returns the basepage, or a negative GEMDOS error.
+*/
+int LoadPrgFile(const char* fileName, const char* cmdLine, const char* environment)
 {
-	unsigned int reserved_long_word;
 	int fd = Fopen(fileName, VFILE_O_RDONLY);
 	if (fd < 0)
 	{
-		// File not found, but let the caller handle that problem.
-		return false;
+		return fd;
 	}
-	Fseek(18,(unsigned short)fd, 0);	// position of reserved long word
-	Fread((unsigned short)fd, 4, &reserved_long_word);
-	Fclose((unsigned short)fd);
-	return reserved_long_word == MINTELF_RESERVED;
+	unsigned short handle = (unsigned short)fd;
+	PrgHeader h;
+	int fileLength = Fseek(0, handle, 2);
+	if (fileLength < 0 || Fseek(0, handle, 0) != 0 ||
+		Fread(handle, PRG_HEADER_SIZE, &h) != PRG_HEADER_SIZE || !ValidPrgHeader(&h, (unsigned int)fileLength))
+	{
+		DbgOut("not a valid program, ");
+		Fclose(handle);
+		return -66;		// Invalid program file format
+	}
+	unsigned int imageLength = h.tlen + h.dlen;
+	unsigned int fixupStart = PRG_HEADER_SIZE + imageLength + h.slen;
+	unsigned int fixupLength = (unsigned int)fileLength - fixupStart;
+	// Before the basepage takes the largest free block.
+	unsigned int reserve = sizeof(struct BasePage) + imageLength + h.blen + CACHE_INFERIOR_MARGIN;
+	bool cached = CacheAllocate(&h, fixupLength, reserve);
+	int res = CreateBasePage(&h, cmdLine, environment);
+	if (res <= 0)
+	{
+		InferiorCacheInvalidate();
+		Fclose(handle);
+		return res;
+	}
+	struct BasePage* bp = (struct BasePage*)res;
+	unsigned char* text = (unsigned char*)(bp + 1);
+	unsigned char* fixup = cached ? imageCache.image + imageLength : text + imageLength;
+	unsigned int above = h.blen;
+	if (!cached && fixupLength > above)
+	{
+		above = fixupLength;
+	}
+	if (text + imageLength + above > bp->p_hitpa)
+	{
+		res = -39;		// Insufficient memory
+	}
+	else if (Fread(handle, (int)imageLength, text) != (int)imageLength ||
+		Fseek(fixupStart, handle, 0) != (int)fixupStart ||
+		Fread(handle, (int)fixupLength, fixup) != (int)fixupLength ||
+		!RelocateImage(text, &h, fixup, fixup + fixupLength, (unsigned int)text))
+	{
+		res = -66;		// Invalid program file format
+	}
+	Fclose(handle);
+	if (res < 0)
+	{
+		InferiorCacheInvalidate();
+		Mfree(bp->p_env);
+		Mfree(bp);
+		return res;
+	}
+	SetupBasePage(bp, &h);
+	Supexec(ClearCaches_super);
+	if (cached)
+	{
+		// The cache is checked against the directory entry.
+		struct DTA* dta = Fgetdta(0);
+		if (Fsfirst(fileName, 0) == 0)
+		{
+			imageCache.fileLength = (unsigned int)fileLength;
+			imageCache.time = dta->d_time;
+			imageCache.date = dta->d_date;
+			// Before any breakpoint is inserted.
+			CacheStore(fileName, bp);
+		}
+		else
+		{
+			InferiorCacheInvalidate();
+		}
+	}
+	SetInferiorHeader(&h);
+	return res;
 }
 
 int LoadInferior(const char* fileName, const char* cmdLine, const char* environment)
@@ -42,16 +505,26 @@ int LoadInferior(const char* fileName, const char* cmdLine, const char* environm
 	// Check that we doesn't already have an inferior loaded.
 	if (inferiorState == NOT_LOADED)
 	{
-		inferior_is_mintelf = CheckIfMintElf(fileName);
-
-		// Load inferior
-		loadres = Pexec(PE_LOAD, fileName, cmdLine, environment);
+		if (IsRamFileName(fileName) && ramReady)
+		{
+			// Already in memory.
+			loadres = RamFileTake(cmdLine);
+		}
+		else if (CacheValid(fileName))
+		{
+			DbgOut("from cache, ");
+			loadres = CacheLoad(cmdLine, environment);
+		}
+		else if (!IsRamFileName(fileName))
+		{
+			loadres = LoadPrgFile(fileName, cmdLine, environment);
+		}
 		if (loadres > 0)
 		{
 			inferiorBasePage = (struct BasePage*)loadres;
 			// Set one time breakpoint at _start.
 			__start_Breakpoint = (unsigned short*)(inferiorBasePage->p_tbase);
-			if (InsertMemoryBreakpoint(__start_Breakpoint) != 0)
+			if (InsertMemoryBreakpoint(__start_Breakpoint, MEMBREAK_START) != 0)
 			{
 				__start_Breakpoint = NULL;
 			}
@@ -104,9 +577,29 @@ bool IsInferiorStartBreak(int si_signo, int si_code)
 		(unsigned int)__start_Breakpoint == GetRegisters()->pc);
 }
 
+void InferiorTextChanged(const void* addr, unsigned int len)
+{
+	if (inferiorBasePage != NULL)
+	{
+		const unsigned char* start = addr;
+		const unsigned char* text = inferiorBasePage->p_tbase;
+		if (start < text + inferiorBasePage->p_tlen && start + len > text)
+		{
+			++inferiorTextChanges;
+		}
+	}
+}
+
+bool TakeInferiorTextChanged(void)
+{
+	bool changed = inferiorTextChanges != reportedTextChanges;
+	reportedTextChanges = inferiorTextChanges;
+	return changed;
+}
+
 void ClearInferiorStartBreak(void)
 {
-	if (RemoveMemoryBreakpoint(__start_Breakpoint) == 0)
+	if (RemoveMemoryBreakpoint(__start_Breakpoint, MEMBREAK_START) == 0)
 	{
 		__start_Breakpoint = NULL;
 	}
@@ -6,6 +6,7 @@
 #ifndef INFERIOR_DEFINED
 #define INFERIOR_DEFINED
 
+#include <stdbool.h>
 #include "gem_basepage.h"
 
 typedef enum
@@ -17,11 +18,65 @@ typedef enum
 
 extern InferiorState inferiorState;
 extern struct BasePage* inferiorBasePage;
-extern bool inferior_is_mintelf;
+
+/*
+	Program header, as in the file.
+	Fast load only clears bss, instead of the whole TPA. The TT RAM flags are honoured by
+	Pexec(PE_CBASEPAGE) from GEMDOS 0.19, older versions always give an ST RAM basepage.
+	RAM: files always get an ST RAM basepage, as it is made before their header arrives.
+*/
+#define PRG_MAGIC			0x601a
+#define PRG_HEADER_SIZE		28
+#define PRG_MAX_SEGMENT		0x01000000
+#define PRGFLAG_FASTLOAD	0x01
+
+typedef struct
+{
+	unsigned short	magic;
+	unsigned int	tlen;
+	unsigned int	dlen;
+	unsigned int	blen;
+	unsigned int	slen;
+	unsigned int	reserved;		// Tells the toolchain.
+	unsigned int	prgflags;
+	unsigned short	absflag;		// 0 if there is a fixup table.
+} __attribute__((packed)) PrgHeader;
+
+typedef enum
+{
+	TOOLCHAIN_UNKNOWN,
+	TOOLCHAIN_MINTELF,				// m68k-atari-mintelf, data symbols use the data segment as base.
+	TOOLCHAIN_ATARI_ELF				// m68k-atari-elf, data symbols use the text segment as base.
+} InferiorToolchain;
+
+extern PrgHeader inferiorHeader;
+extern InferiorToolchain inferiorToolchain;
 extern char inferior_filename[];
 extern char inferior_cmdline[];
 extern char inferior_workpath[];
 
+/*
+	"RAM:" files are loaded into memory as an inferior when written with vFile, and run with vRun.
+	Used by file_io.c. RAM_FILE_FD is never a GEMDOS handle.
+*/
+#define RAM_FILE_FD		0x7ff0
+bool IsRamFileName(const char* fileName);
+int RamFileOpen(int* ioErrno);
+int RamFileWrite(const void* buf, int offset, int nbytes, int* ioErrno);
+int RamFileClose(int* ioErrno);
+// Drops the cached inferior image, as a file have been written or deleted.
+void InferiorCacheInvalidate(void);
+
+/*
+	The text is reported as rom in the memory map, so a host may cache it between stops.
+	The server calls InferiorTextChanged when it writes text behind the host's back, as with
+	coverage, tracepoint, timing and start breakpoints, but not for gdb's own M and Z packets.
+	The next stop reply tells the host with "textchanged:;", which gdb ignores.
+*/
+void InferiorTextChanged(const void* addr, unsigned int len);
+// Returns true once for every stop reply after the text changed.
+bool TakeInferiorTextChanged(void);
+
 int LoadInferior(const char* fileName, const char* cmdLine, const char* environment);
 bool RunInferior(int* return_code);
 void TerminateInferior(int si_signo);
@@ -0,0 +1,354 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+#include <stdbool.h>
+#include "live.h"
+#include "critical.h"
+#include "context.h"
+#include "bios_calls.h"
+#include "hex.h"
+
+/*
+	Runs at interrupt level, in the inferior context, so addresses are used as they are.
+	Replies are sent with the interrupts still blocked, so requests should be kept small.
+*/
+#define LIVE_HEADER_SIZE	5
+
+typedef enum
+{
+	LIVE_IDLE,		// Waiting for LIVE_LEAD.
+	LIVE_COMMAND,
+	LIVE_HEADER,	// Collecting liveNeeded bytes into liveHeader.
+	LIVE_DATA		// Writing liveLen bytes to liveAddr.
+} LivePhase;
+
+LiveRange liveRanges[LIVE_MAX_RANGES];
+short numLiveRanges = 0;
+
+void (*LiveTransmit)(unsigned char byte) = 0;
+bool (*LiveTransmitReady)(void) = 0;
+
+LivePhase livePhase = LIVE_IDLE;
+unsigned char liveCommand;
+unsigned char liveHeader[LIVE_HEADER_SIZE];
+short liveCount;
+short liveNeeded;
+short liveRangesLeft;				// For 'd'.
+unsigned char* liveAddr;
+unsigned char liveLen;
+unsigned char liveStatus;
+unsigned char liveSum;
+volatile bool liveBusy = false;		// Keeps the sample timer away while a request is served.
+
+/*
+	Periodic sampling.
+	Timer A runs with the /64 prescaler, from the 2.4576 MHz MFP clock.
+*/
+#define MFP_TIMER_A_CHANNEL	13
+#define MFP_TACR			((volatile unsigned char*)0xfffffa19)
+#define MFP_TADR			((volatile unsigned char*)0xfffffa1f)
+#define MFP_TIMER_A_DIV64	5
+#define SAMPLE_HEADER		"%Sample:"
+
+void LiveSampleTimer(void);
+
+bool sampleActive = false;
+unsigned short sampleTicks;			// Ticks between captures.
+unsigned short sampleTicksLeft;
+unsigned int sampleSequence;
+unsigned char sampleBuffer[LIVE_SAMPLE_SIZE];
+short sampleLength;
+bool samplePending = false;			// sampleBuffer have a capture that isn't being sent.
+char sampleSend[sizeof(SAMPLE_HEADER) + 8 + 1 + LIVE_SAMPLE_SIZE * 2 + 3];
+short sampleSendPos = 0;
+short sampleSendLength = 0;
+
+void LiveReset(void)
+{
+	livePhase = LIVE_IDLE;
+}
+
+void LiveWaitForHeader(short size)
+{
+	livePhase = LIVE_HEADER;
+	liveCount = 0;
+	liveNeeded = size;
+}
+
+void LiveReplyByte(unsigned char c)
+{
+	liveSum += c;
+	LiveTransmit(c);
+}
+
+// Sends the rest of a notification that have been started.
+void LiveSampleFlush(void)
+{
+	while (sampleSendPos < sampleSendLength)
+	{
+		LiveTransmit((unsigned char)sampleSend[sampleSendPos++]);
+	}
+}
+
+void LiveReplyStart(void)
+{
+	// Finish the notification being sent, so they don't mix.
+	LiveSampleFlush();
+	LiveTransmit(LIVE_LEAD);
+	LiveTransmit(liveCommand);
+	liveSum = 0;
+}
+
+void LiveReplyMemory(unsigned char* addr, unsigned char len)
+{
+	for (unsigned char i = 0; i < len; ++i)
+	{
+		unsigned char c;
+		if (ExceptionSafeMemoryRead(addr + i, &c) != 0)
+		{
+			c = 0;
+			liveStatus = 1;
+		}
+		LiveReplyByte(c);
+	}
+}
+
+void LiveReplyEnd(void)
+{
+	LiveReplyByte(liveStatus);
+	LiveTransmit(liveSum);
+	livePhase = LIVE_IDLE;
+}
+
+void LiveHeaderDone(void)
+{
+	liveAddr = (unsigned char*)(((unsigned int)liveHeader[0] << 24) | ((unsigned int)liveHeader[1] << 16) |
+		((unsigned int)liveHeader[2] << 8) | (unsigned int)liveHeader[3]);
+	liveLen = liveHeader[4];
+	switch (liveCommand)
+	{
+	case 'r':
+		LiveReplyStart();
+		LiveReplyMemory(liveAddr, liveLen);
+		LiveReplyEnd();
+		break;
+	case 'w':
+		livePhase = LIVE_DATA;
+		if (liveLen == 0)
+		{
+			LiveReplyStart();
+			LiveReplyEnd();
+		}
+		break;
+	case 'd':
+		if (liveRangesLeft < 0)
+		{
+			// The count byte.
+			liveRangesLeft = liveHeader[0];
+			numLiveRanges = 0;
+		}
+		else
+		{
+			--liveRangesLeft;
+			if (numLiveRanges < LIVE_MAX_RANGES)
+			{
+				liveRanges[numLiveRanges].addr = liveAddr;
+				liveRanges[numLiveRanges].len = liveLen;
+				++numLiveRanges;
+			}
+			else
+			{
+				liveStatus = 1;
+			}
+		}
+		if (liveRangesLeft == 0)
+		{
+			LiveReplyStart();
+			LiveReplyEnd();
+		}
+		else
+		{
+			LiveWaitForHeader(LIVE_HEADER_SIZE);
+		}
+		break;
+	}
+}
+
+bool LiveInput(unsigned char byte)
+{
+	if (LiveTransmit == 0 || (livePhase == LIVE_IDLE && byte != LIVE_LEAD))
+	{
+		return false;
+	}
+	liveBusy = true;
+	switch (livePhase)
+	{
+	case LIVE_IDLE:
+		livePhase = LIVE_COMMAND;
+		break;
+	case LIVE_COMMAND:
+		liveCommand = byte;
+		liveStatus = 0;
+		switch (byte)
+		{
+		case 'r':
+		case 'w':
+			LiveWaitForHeader(LIVE_HEADER_SIZE);
+			break;
+		case 'd':
+			liveRangesLeft = -1;
+			LiveWaitForHeader(1);
+			break;
+		case 's':
+			LiveReplyStart();
+			for (short r = 0; r < numLiveRanges; ++r)
+			{
+				LiveReplyMemory(liveRanges[r].addr, liveRanges[r].len);
+			}
+			LiveReplyEnd();
+			break;
+		default:
+			// Unknown, the host will time out.
+			livePhase = LIVE_IDLE;
+			break;
+		}
+		break;
+	case LIVE_HEADER:
+		liveHeader[liveCount++] = byte;
+		if (liveCount == liveNeeded)
+		{
+			LiveHeaderDone();
+		}
+		break;
+	case LIVE_DATA:
+		if (ExceptionSafeMemoryWrite(liveAddr++, byte) != 0)
+		{
+			liveStatus = 1;
+		}
+		if (--liveLen == 0)
+		{
+			LiveReplyStart();
+			LiveReplyEnd();
+		}
+		break;
+	}
+	liveBusy = false;
+	return true;
+}
+
+bool LiveSampleStart(unsigned short rate)
+{
+	if (LiveTransmit == 0 || rate == 0 || rate > LIVE_TICK_RATE)
+	{
+		return false;
+	}
+	LiveSampleStop();
+	if (!ClaimInferiorMfpInterrupt(MFP_TIMER_A_CHANNEL, LiveSampleTimer))
+	{
+		return false;
+	}
+	sampleTicks = (unsigned short)(LIVE_TICK_RATE / rate);
+	sampleTicksLeft = sampleTicks;
+	sampleSequence = 0;
+	samplePending = false;
+	sampleSendPos = sampleSendLength = 0;
+	// The interrupt only gets enabled in the inferior context.
+	*MFP_TACR = 0;
+	*MFP_TADR = (unsigned char)(2457600 / 64 / LIVE_TICK_RATE);
+	*MFP_TACR = MFP_TIMER_A_DIV64;
+	sampleActive = true;
+	return true;
+}
+
+void LiveSampleStop(void)
+{
+	if (sampleActive)
+	{
+		sampleActive = false;
+		*MFP_TACR = 0;
+		ReleaseInferiorMfpInterrupt(MFP_TIMER_A_CHANNEL, LiveSampleTimer);
+	}
+}
+
+int LiveSampleDiscard_super(void)
+{
+	*MFP_TACR = 0;
+	return 0;
+}
+
+void LiveSampleDiscard(void)
+{
+	if (sampleActive)
+	{
+		sampleActive = false;
+		Supexec(LiveSampleDiscard_super);
+	}
+}
+
+void LiveSampleFormat(void)
+{
+	char* out = sampleSend;
+	for (const char* h = SAMPLE_HEADER; *h != 0; ++h)
+	{
+		*out++ = *h;
+	}
+	for (short shift = 28; shift >= 0; shift -= 4)
+	{
+		*out++ = NibbleToHex((unsigned char)(sampleSequence >> shift));
+	}
+	*out++ = ';';
+	for (short i = 0; i < sampleLength; ++i)
+	{
+		*out++ = NibbleToHex(sampleBuffer[i] >> 4);
+		*out++ = NibbleToHex(sampleBuffer[i]);
+	}
+	// The checksum covers everything after the '%'.
+	unsigned char sum = 0;
+	for (char* c = sampleSend + 1; c < out; ++c)
+	{
+		sum += (unsigned char)*c;
+	}
+	*out++ = '#';
+	*out++ = NibbleToHex(sum >> 4);
+	*out++ = NibbleToHex(sum);
+	sampleSendLength = (short)(out - sampleSend);
+	sampleSendPos = 0;
+}
+
+void LiveSampleTick(void)
+{
+	if (liveBusy)
+	{
+		return;
+	}
+	if (sampleSendPos < sampleSendLength && LiveTransmitReady())
+	{
+		LiveTransmit((unsigned char)sampleSend[sampleSendPos++]);
+	}
+	if (--sampleTicksLeft == 0)
+	{
+		sampleTicksLeft = sampleTicks;
+		short len = 0;
+		for (short r = 0; r < numLiveRanges; ++r)
+		{
+			for (unsigned char i = 0; i < liveRanges[r].len && len < LIVE_SAMPLE_SIZE; ++i)
+			{
+				if (ExceptionSafeMemoryRead(liveRanges[r].addr + i, &sampleBuffer[len]) != 0)
+				{
+					sampleBuffer[len] = 0;
+				}
+				++len;
+			}
+		}
+		sampleLength = len;
+		++sampleSequence;
+		samplePending = true;
+	}
+	if (samplePending && sampleSendPos == sampleSendLength)
+	{
+		LiveSampleFormat();
+		samplePending = false;
+	}
+}
@@ -0,0 +1,88 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+/*
+	Side-band memory access while the inferior runs.
+	The AUX receive interrupts hand every byte to LiveInput while CTRL-C is enabled, and
+	requests are answered directly from interrupt level, without stopping the inferior.
+	This lets a host tool graph variables at many samples per second.
+
+	All requests start with LIVE_LEAD, which gdb never sends outside of a packet.
+	Numbers are big endian. Every reply ends with a status byte (0 is ok) and an 8 bit
+	sum of the data and status bytes. Bytes that can't be read are sent as 0 with status 1.
+
+	LIVE_LEAD 'r' addr.l len.b				->	LIVE_LEAD 'r' data... status.b sum.b
+	LIVE_LEAD 'w' addr.l len.b data...		->	LIVE_LEAD 'w' status.b sum.b
+	LIVE_LEAD 'd' count.b {addr.l len.b}...	->	LIVE_LEAD 'd' status.b sum.b
+	LIVE_LEAD 's'							->	LIVE_LEAD 's' data... status.b sum.b
+
+	'd' defines the sample set, at most LIVE_MAX_RANGES ranges, and 's' reads all of it.
+
+	The sample set can also be sent periodically with "monitor sample". MFP timer A then
+	ticks at LIVE_TICK_RATE, about one byte time at 9600 baud, and captures the sample set
+	every rate:th of a second into a buffer. The tick sends one byte at a time of the
+	previous capture, so the interrupt never waits for the serial port. Captures are sent
+	as notifications, that gdb ignores:
+		%Sample:sequence;data#checksum
+	Sequence and data are hex. Captures made while the previous is being sent replace each
+	other, so gaps in the sequence tells how many were lost.
+
+	The serial port is shared with gdb, so the host must keep the streams apart.
+	Only available with the MFP and SCC devices.
+*/
+#ifndef LIVE_DEFINED
+#define LIVE_DEFINED
+
+#include <stdbool.h>
+
+#define LIVE_LEAD		0x10
+#define LIVE_MAX_RANGES	16
+#define LIVE_SAMPLE_SIZE	128		// Max bytes in a periodic capture.
+#define LIVE_TICK_RATE		960
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+	unsigned char*	addr;
+	unsigned char	len;
+} LiveRange;
+
+extern LiveRange liveRanges[LIVE_MAX_RANGES];
+extern short numLiveRanges;
+
+// Sends a byte without interrupts, set by the device. Live access is off while 0.
+extern void (*LiveTransmit)(unsigned char byte);
+// Returns true if LiveTransmit can send without waiting.
+extern bool (*LiveTransmitReady)(void);
+
+// Called from the receive interrupt. Returns true if the byte was part of a side-band request.
+bool LiveInput(unsigned char byte);
+// Drops a partly received request.
+void LiveReset(void);
+
+/*
+	Starts sending the sample set rate times a second while the inferior runs.
+	Returns false if timer A is used by the inferior. The inferior must be stopped.
+*/
+bool LiveSampleStart(unsigned short rate);
+void LiveSampleStop(void);
+// Stops the timer when the inferior is gone. User mode.
+void LiveSampleDiscard(void);
+// Called from the timer A interrupt.
+void LiveSampleTick(void);
+/*
+	Sends the rest of a notification that the tick have started. Must be called before the server
+	sends anything after the inferior stopped, as the tick can't finish it while timer A is masked.
+*/
+void LiveSampleFlush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIVE_DEFINED
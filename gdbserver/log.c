@@ -7,6 +7,7 @@
 #include "hex.h"
 #include "bios_calls.h"
 #include "clib.h"
+#include "gem_basepage.h"
 
 const char newline[] = "\r\n";
 
@@ -15,7 +16,31 @@ bool			log_debug_remote = false;		// cmdline option --debug-remote
 
 #ifndef NO_CON_OR_LOG
 
+/*
+	Debug output goes to a RAM ring buffer, as writing it out while gdb waits changes the
+	timing of what is being debugged. The buffer is written out as text when the server waits
+	for a packet, on "monitor log flush", and at exit. When full, the oldest records are
+	dropped and counted.
+	Strings in the server text and data are constant, and only their address is stored.
+	Anything else, as packets, is copied. ConOut is never buffered, but flushes the buffer first.
+	With --log-sync, debug output is written directly, as text.
+*/
+#define LOG_RING_SIZE	8192
+#define LOG_REC_CONST	1		// address.l
+#define LOG_REC_COPY	2		// length.b bytes...
+#define LOG_REC_VALUE	3		// name address.l value.l, name is 0 if copied before.
+#define LOG_COPY_MAX	255
+#define LOG_FLUSH_SIZE	128
+
 int 			logHandle;
+bool			logSync = false;
+unsigned char	logRing[LOG_RING_SIZE];
+unsigned short	logHead = 0;		// Oldest record.
+unsigned short	logUsed = 0;
+unsigned int	logDropped = 0;		// Records dropped since the last flush.
+bool			logFlushing = false;
+char			logText[LOG_FLUSH_SIZE];
+short			logTextLength = 0;
 
 void InitLog(int argc, char** argv)
 {
@@ -24,12 +49,14 @@ void InitLog(int argc, char** argv)
 	{
 		log_debug_remote = true;
 		log_debug = true;
+		logSync = StringCompare("--log-sync", argv[1]) > 0;
 		logHandle = Fcreate("gdblog.txt", 0);
 	}
 }
 
 void ExitLog(void)
 {
+	LogFlush();
 	if (logHandle > 0)
 	{
 		Fclose((unsigned short)logHandle);
@@ -38,46 +65,29 @@ void ExitLog(void)
 	}
 }
 
-void ConOut(const char* txt)
+void WriteLogText(const char* txt, int len)
 {
 	if (logHandle > 0)
 	{
-		Fwrite((unsigned short)logHandle, strlen(txt), txt);
+		Fwrite((unsigned short)logHandle, len, txt);
 	}
 	else
 	{
-		int len = 0;
-		while (txt[len] != 0) 
+		for (int i = 0; i < len; ++i)
 		{
-			Bconout(DEV_CONSOLE, txt[len]);
-			++len;
+			Bconout(DEV_CONSOLE, txt[i]);
 		}
 	}
 }
 
-void DbgOut(const char* txt)
-{
-#ifndef DEBUG_OPTIONS_ON
-	if (log_debug)
-#endif
-	{
-		ConOut(txt);
-	}
-}
-
-void DbgRemOut(const char* txt)
+void ConOut(const char* txt)
 {
-#ifndef DEBUG_OPTIONS_ON
-	if (log_debug_remote)
-#endif
-	{
-		ConOut(txt);
-	}
+	LogFlush();
+	WriteLogText(txt, strlen(txt));
 }
 
-void ConOutVal(const char* name, unsigned int val)
+void FormatHex(unsigned int val, char* buf)
 {
-	char buf[12];
 	int i = 8;
 	buf[i] = 0;
 	while (--i >= 0)
@@ -85,6 +95,12 @@ void ConOutVal(const char* name, unsigned int val)
 		buf[i] = NibbleToHex(val);
 		val = val >> 4;
 	}
+}
+
+void ConOutVal(const char* name, unsigned int val)
+{
+	char buf[12];
+	FormatHex(val, buf);
 	ConOut("\t");
 	ConOut(name);
 	ConOut(": 0x");
@@ -92,13 +108,223 @@ void ConOutVal(const char* name, unsigned int val)
 	ConOut(newline);
 }
 
+bool IsConstString(const char* txt)
+{
+	struct BasePage* serverBasePage = _BasePage; // Defined in crt0
+	return (const unsigned char*)txt >= serverBasePage->p_tbase &&
+		(const unsigned char*)txt < serverBasePage->p_bbase;
+}
+
+unsigned char LogGetByte(unsigned short pos)
+{
+	return logRing[(logHead + pos) % LOG_RING_SIZE];
+}
+
+unsigned int LogGetLong(unsigned short pos)
+{
+	return ((unsigned int)LogGetByte(pos) << 24) | ((unsigned int)LogGetByte(pos + 1) << 16) |
+		((unsigned int)LogGetByte(pos + 2) << 8) | LogGetByte(pos + 3);
+}
+
+unsigned short LogRecordSize(void)
+{
+	switch (LogGetByte(0))
+	{
+		case LOG_REC_CONST:	return 5;
+		case LOG_REC_COPY:	return (unsigned short)(2 + LogGetByte(1));
+		default:			return 9;
+	}
+}
+
+void LogDropOldest(void)
+{
+	unsigned short size = LogRecordSize();
+	logHead = (unsigned short)((logHead + size) % LOG_RING_SIZE);
+	logUsed -= size;
+	++logDropped;
+}
+
+void LogPutByte(unsigned char c)
+{
+	logRing[(logHead + logUsed) % LOG_RING_SIZE] = c;
+	++logUsed;
+}
+
+void LogPutLong(unsigned int v)
+{
+	for (short shift = 24; shift >= 0; shift -= 8)
+	{
+		LogPutByte((unsigned char)(v >> shift));
+	}
+}
+
+// Drops old records until size bytes are free.
+void LogReserve(unsigned short size)
+{
+	while (LOG_RING_SIZE - logUsed < size)
+	{
+		LogDropOldest();
+	}
+}
+
+void LogText(const char* txt)
+{
+	if (IsConstString(txt))
+	{
+		LogReserve(5);
+		LogPutByte(LOG_REC_CONST);
+		LogPutLong((unsigned int)txt);
+		return;
+	}
+	int len = strlen(txt);
+	while (len > 0)
+	{
+		unsigned char n = (unsigned char)(len > LOG_COPY_MAX ? LOG_COPY_MAX : len);
+		LogReserve((unsigned short)(n + 2));
+		LogPutByte(LOG_REC_COPY);
+		LogPutByte(n);
+		for (unsigned char i = 0; i < n; ++i)
+		{
+			LogPutByte((unsigned char)*txt++);
+		}
+		len -= n;
+	}
+}
+
+void LogValue(const char* name, unsigned int val)
+{
+	bool copied = !IsConstString(name);
+	if (copied)
+	{
+		LogText(name);
+	}
+	LogReserve(9);
+	LogPutByte(LOG_REC_VALUE);
+	LogPutLong(copied ? 0 : (unsigned int)name);
+	LogPutLong(val);
+}
+
+void LogFlushText(const char* txt, int len)
+{
+	for (int i = 0; i < len; ++i)
+	{
+		if (logTextLength == LOG_FLUSH_SIZE)
+		{
+			WriteLogText(logText, logTextLength);
+			logTextLength = 0;
+		}
+		logText[logTextLength++] = txt[i];
+	}
+}
+
+void LogFlushString(const char* txt)
+{
+	LogFlushText(txt, strlen(txt));
+}
+
+void LogFlush(void)
+{
+	if (logFlushing || (logUsed == 0 && logDropped == 0))
+	{
+		return;
+	}
+	// GEMDOS may end up here again through the exception handlers.
+	logFlushing = true;
+	char buf[12];
+	if (logDropped != 0)
+	{
+		FormatHex(logDropped, buf);
+		LogFlushString("\r\n(log records dropped: 0x");
+		LogFlushString(buf);
+		LogFlushString(")\r\n");
+		logDropped = 0;
+	}
+	while (logUsed != 0)
+	{
+		const char* txt;
+		switch (LogGetByte(0))
+		{
+			case LOG_REC_CONST:
+				txt = (const char*)LogGetLong(1);
+				LogFlushString(txt);
+				break;
+			case LOG_REC_COPY:
+				for (unsigned short i = 0; i < LogGetByte(1); ++i)
+				{
+					char c = (char)LogGetByte((unsigned short)(2 + i));
+					LogFlushText(&c, 1);
+				}
+				break;
+			default:
+				txt = (const char*)LogGetLong(1);
+				FormatHex(LogGetLong(5), buf);
+				if (txt != 0)
+				{
+					LogFlushString("\t");
+					LogFlushString(txt);
+				}
+				LogFlushString(": 0x");
+				LogFlushString(buf);
+				LogFlushString(newline);
+				break;
+		}
+		unsigned short size = LogRecordSize();
+		logHead = (unsigned short)((logHead + size) % LOG_RING_SIZE);
+		logUsed -= size;
+	}
+	WriteLogText(logText, logTextLength);
+	logTextLength = 0;
+	logFlushing = false;
+}
+
+void DbgOut(const char* txt)
+{
+#ifndef DEBUG_OPTIONS_ON
+	if (log_debug)
+#endif
+	{
+		if (logSync)
+		{
+			ConOut(txt);
+		}
+		else
+		{
+			LogText(txt);
+		}
+	}
+}
+
+void DbgRemOut(const char* txt)
+{
+#ifndef DEBUG_OPTIONS_ON
+	if (log_debug_remote)
+#endif
+	{
+		if (logSync)
+		{
+			ConOut(txt);
+		}
+		else
+		{
+			LogText(txt);
+		}
+	}
+}
+
 void DbgOutVal(const char* name, unsigned int val)
 {
 #ifndef DEBUG_OPTIONS_ON
 	if (log_debug)
 #endif
 	{
-		ConOutVal(name, val);
+		if (logSync)
+		{
+			ConOutVal(name, val);
+		}
+		else
+		{
+			LogValue(name, val);
+		}
 	}
 }
 
@@ -108,7 +334,14 @@ void DbgRemOutVal(const char* name, unsigned int val)
 	if (log_debug_remote)
 #endif
 	{
-		ConOutVal(name, val);
+		if (logSync)
+		{
+			ConOutVal(name, val);
+		}
+		else
+		{
+			LogValue(name, val);
+		}
 	}
 }
 
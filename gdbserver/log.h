@@ -27,6 +27,7 @@ extern bool			log_debug_remote;		// cmdline option --debug-remote
 #define ConOutVal(name, val)
 #define DbgOutVal(name, val)
 #define DbgRemOutVal(name, val)
+#define LogFlush()
 #else // NO_CON_OR_LOG
 void InitLog(int argc, char** argv);
 void ExitLog(void);
@@ -36,6 +37,8 @@ void DbgRemOut(const char* txt);
 void ConOutVal(const char* name, unsigned int val);
 void DbgOutVal(const char* name, unsigned int val);
 void DbgRemOutVal(const char* name, unsigned int val);
+// Writes out the buffered debug output. Called when the server is idle.
+void LogFlush(void);
 #endif // NO_CON_OR_LOG
 
 #endif // LOG_DEFINED
@@ -18,6 +18,7 @@
 #include "log.h"
 #include "clib.h"
 #include "inferior.h"
+#include "memory_map.h"
 
 /*
 	Option handling for this server is made to follow the real gdbserver documentation.
@@ -38,6 +39,13 @@
 		--multi
 			Starts the server without any executable to debug.
 			Waits for gdb to connect with target extended-remote and tell us what executable to debug.
+		--log
+			Must be first. Turns on --debug and --remote-debug, and writes to gdblog.txt instead of the console.
+			Debug output is buffered in memory and written when the server waits for gdb.
+		--log-sync
+			As --log, but every line is written directly, which slows the server down.
+		--text-rw
+			Reports the inferior text as ram in the memory map, so gdb allows writing to it.
 */
 int HandleOptions(int argc, char** argv)
 {
@@ -73,6 +81,11 @@ int HandleOptions(int argc, char** argv)
 					option_multi = true;
 					DbgOut("Using: --multi\r\n");
 				}
+				else if (StringCompare("--text-rw", argv[i]) > 0)
+				{
+					memoryMapTextRom = false;
+					DbgOut("Using: --text-rw\r\n");
+				}
 				else if (StringCompare("--once", argv[i]) > 0)
 				{
 					run_once = true;
@@ -89,6 +102,10 @@ int HandleOptions(int argc, char** argv)
 					log_debug = true;
 					DbgOut("Using: --debug\r\n");
 				}
+				else if (StringCompare("--log-sync", argv[i]) > 0)
+				{
+					DbgOut("Using: --log-sync\r\n");
+				}
 				else if (StringCompare("--log", argv[i]) > 0)
 				{
 					DbgOut("Using: --log\r\n");
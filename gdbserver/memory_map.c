@@ -0,0 +1,162 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "memory_map.h"
+#include "cookies.h"
+#include "log.h"
+#include "hex.h"
+#include "inferior.h"
+
+/*
+	ST RAM runs from 0 to _phystop, and TT RAM from 0x01000000 to _ramtop when _ramvalid says
+	it is there. The ROM start is taken from the OS header, as it may also be a RAM TOS. The
+	ROM size can't be read, so it is known from where it starts and the machine.
+	The text of a loaded inferior is cut out of the RAM as rom, so gdb uses hardware
+	breakpoints (Z1) there, which the server plants as any other breakpoint.
+	gdb also refuses to write to rom, so code can't be patched from gdb unless --text-rw is used.
+	Text changes gdb can't know about, as traps planted by the server, are reported with
+	textchanged in the stop reply, so a host can keep text cached over stops.
+*/
+#define SYSVAR_PHYSTOP		((volatile unsigned int*)0x42e)
+#define SYSVAR_SYSBASE		((volatile unsigned int**)0x4f2)
+#define SYSVAR_RAMTOP		((volatile unsigned int*)0x5a4)
+#define SYSVAR_RAMVALID		((volatile unsigned int*)0x5a8)
+#define RAMVALID_MAGIC		0x1357bd13
+#define TT_RAM_START		0x01000000
+#define CARTRIDGE_START		0xfa0000
+#define CARTRIDGE_LENGTH	0x20000
+#define TOS1_ROM_START		0xfc0000
+#define TOS1_ROM_LENGTH		0x30000
+#define TOS2_ROM_LENGTH		0x40000		// STE
+#define TOS3_ROM_LENGTH		0x80000		// TT and Falcon
+#define MEMORY_MAP_XML_SIZE	640
+
+unsigned int memPhystop = 0;
+unsigned int memRomStart = 0;
+unsigned int memRomLength = 0;		// 0 when TOS isn't in ROM.
+unsigned int memRamtop = 0;			// 0 when there is no TT RAM.
+
+char memoryMapXml[MEMORY_MAP_XML_SIZE];
+short memoryMapLength;
+
+const char memoryMapHeader[] =
+	"<?xml version=\"1.0\"?>\n"
+	"<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\" \"http://sourceware.org/gdb/gdb-memory-map.dtd\">\n"
+	"<memory-map>\n"
+	;
+const char memoryMapFooter[] = "</memory-map>\n";
+
+#pragma GCC diagnostic push
+// Remove out of bounds warning, as the system variable reads will trigger false warnings.
+#pragma GCC diagnostic ignored "-Warray-bounds="
+
+int ReadMemoryLayout(void)
+{
+	memPhystop = *SYSVAR_PHYSTOP;
+	// os_beg is the third long of the OS header.
+	memRomStart = (*SYSVAR_SYSBASE)[2];
+	memRomLength = 0;
+	if (memRomStart == TOS1_ROM_START)
+	{
+		memRomLength = TOS1_ROM_LENGTH;
+	}
+	else if (memRomStart >= memPhystop && memRomStart < CARTRIDGE_START)
+	{
+		memRomLength = (Cookie_MCH >> 16) >= 2 ? TOS3_ROM_LENGTH : TOS2_ROM_LENGTH;
+	}
+	memRamtop = 0;
+	if (*SYSVAR_RAMVALID == RAMVALID_MAGIC && *SYSVAR_RAMTOP > TT_RAM_START)
+	{
+		memRamtop = *SYSVAR_RAMTOP;
+	}
+	DbgOutVal("Memory phystop", memPhystop);
+	DbgOutVal("Memory rom", memRomStart);
+	DbgOutVal("Memory ramtop", memRamtop);
+	return 0;
+}
+
+#pragma GCC diagnostic pop
+
+void AppendXml(const char* str)
+{
+	while (*str != 0 && memoryMapLength < MEMORY_MAP_XML_SIZE - 1)
+	{
+		memoryMapXml[memoryMapLength++] = *str++;
+	}
+}
+
+void AppendXmlHex(unsigned int val)
+{
+	char buf[11] = {'0', 'x'};
+	short pos = 2;
+	short shift = 28;
+	while (shift > 0 && ((val >> shift) & 0xf) == 0)
+	{
+		shift -= 4;
+	}
+	for (; shift >= 0; shift -= 4)
+	{
+		buf[pos++] = NibbleToHex(val >> shift);
+	}
+	buf[pos] = 0;
+	AppendXml(buf);
+}
+
+void AppendRegion(unsigned int start, unsigned int end, bool rom)
+{
+	if (end <= start)
+	{
+		return;
+	}
+	AppendXml(rom ? "<memory type=\"rom\" start=\"" : "<memory type=\"ram\" start=\"");
+	AppendXmlHex(start);
+	AppendXml("\" length=\"");
+	AppendXmlHex(end - start);
+	AppendXml("\"/>\n");
+}
+
+bool memoryMapTextRom = true;
+
+void AppendRamRegion(unsigned int start, unsigned int end)
+{
+	if (memoryMapTextRom && inferiorBasePage != NULL)
+	{
+		unsigned int text = (unsigned int)inferiorBasePage->p_tbase;
+		unsigned int textEnd = text + inferiorBasePage->p_tlen;
+		if (text >= start && textEnd <= end)
+		{
+			AppendRegion(start, text, false);
+			AppendRegion(text, textEnd, true);
+			start = textEnd;
+		}
+	}
+	AppendRegion(start, end, false);
+}
+
+unsigned int GetMemoryMapXml(const char* parts[])
+{
+	// Regions are added in address order.
+	memoryMapLength = 0;
+	AppendRamRegion(0, memPhystop);
+	if (memRomStart < CARTRIDGE_START)
+	{
+		AppendRegion(memRomStart, memRomStart + memRomLength, true);
+	}
+	AppendRegion(CARTRIDGE_START, CARTRIDGE_START + CARTRIDGE_LENGTH, true);
+	if (memRomStart >= CARTRIDGE_START)
+	{
+		// TOS 1 ROM comes right after the cartridge.
+		AppendRegion(memRomStart, memRomStart + memRomLength, true);
+	}
+	AppendRamRegion(TT_RAM_START, memRamtop);
+	memoryMapXml[memoryMapLength] = 0;
+	parts[0] = memoryMapHeader;
+	parts[1] = memoryMapXml;
+	parts[2] = memoryMapFooter;
+	parts[3] = 0;
+	return (unsigned int)(sizeof(memoryMapHeader) - 1 + memoryMapLength + sizeof(memoryMapFooter) - 1);
+}
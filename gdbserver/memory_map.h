@@ -0,0 +1,36 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+/*
+	The gdb memory map, sent with qXfer:memory-map:read.
+	gdb refuses to access addresses outside of the map, so it never tries to read I/O space
+	while unwinding the stack or showing expressions. The hardware registers can still be
+	reached after telling gdb they are there, at both their 24 bit and 32 bit addresses:
+		mem 0xff8000 0x1000000 rw
+		mem 0xffff8000 0 rw
+	A high address of 0 is the top of the address space to gdb.
+*/
+#ifndef MEMORY_MAP_DEFINED
+#define MEMORY_MAP_DEFINED
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Cleared by --text-rw, the text is then reported as ram so gdb allows writing to it.
+extern bool memoryMapTextRom;
+
+// Reads the system variables the map is built from. Cookies must have been read. Supervisor mode.
+int ReadMemoryLayout(void);
+// Builds the memory map xml into parts, like GetTargetXml. Returns the length.
+unsigned int GetMemoryMapXml(const char* parts[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEMORY_MAP_DEFINED
@@ -0,0 +1,309 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+#include <stdbool.h>
+#include "mmu.h"
+#include "critical.h"
+#include "cookies.h"
+#include "exceptions.h"
+#include "inferior.h"
+
+/*
+	TOS sets up the 68030 mmu with an identity mapping on TT and Falcon.
+	We don't build any tables of our own, we only set the WP bit in the descriptor
+	that maps a watched address. The WP bit is bit 2 in all descriptor formats.
+	Descriptors that cover more than the inferior TPA, or the supervisor stack,
+	are never protected, as exception stack frames and the server itself must be
+	able to write freely.
+*/
+#define NUM_MMU_PAGES	8		// Max number of descriptors protected at the same time.
+#define DESC_WP			0x4
+
+#define TC_E			0x80000000
+#define TC_SRE			0x02000000
+#define TC_FCL			0x01000000
+#define TT_E			0x8000
+
+typedef struct
+{
+	unsigned int*	descriptor;		// 0 if unused.
+	unsigned int	start;
+	unsigned int	size;
+	unsigned short	refs;
+} MmuPage;
+
+MmuPage mmuPages[NUM_MMU_PAGES];
+bool mmuProtecting = false;
+bool mmuSuspended = false;
+
+// Layout as written by MmuGetRegisters
+enum {MMU_TC, MMU_CRP, MMU_SRP = 3, MMU_TT0 = 5, MMU_TT1, NUM_MMU_REGISTERS};
+
+/*
+	Walks the translation tree from a root pointer and returns the page descriptor for addr.
+	Returns 0 if the address isn't mapped by a page descriptor we can use.
+*/
+unsigned int* FindDescriptor(unsigned int* rootPointer, unsigned int tc, unsigned int addr, unsigned int* start, unsigned int* size)
+{
+	unsigned int dt = rootPointer[0] & 0x3;
+	unsigned int tableAddr = rootPointer[1];
+	unsigned int* desc = 0;
+	short is = (short)((tc >> 16) & 0xf);
+	short remaining = 32 - is;
+	unsigned int bits = addr << is;
+	for (short level = 0; level < 4 && dt != 1; ++level)
+	{
+		short ti = (short)((tc >> (12 - (level << 2))) & 0xf);
+		if (dt == 0 || ti == 0)
+		{
+			// Invalid, or indirect descriptor at the last level.
+			return 0;
+		}
+		unsigned int index = bits >> (32 - ti);
+		bits <<= ti;
+		remaining -= ti;
+		if (dt == 2)
+		{
+			desc = (unsigned int*)(tableAddr & 0xfffffff0) + index;
+			tableAddr = desc[0];
+		}
+		else
+		{
+			desc = (unsigned int*)(tableAddr & 0xfffffff0) + (index << 1);
+			tableAddr = desc[1];
+		}
+		dt = desc[0] & 0x3;
+	}
+	if (dt != 1 || desc == 0)
+	{
+		return 0;
+	}
+	*size = 1 << remaining;
+	*start = addr & ~(*size - 1);
+	return desc;
+}
+
+bool TransparentlyTranslated(unsigned int tt, unsigned int addr)
+{
+	if ((tt & TT_E) == 0)
+	{
+		return false;
+	}
+	unsigned int base = tt >> 24;
+	unsigned int mask = (tt >> 16) & 0xff;
+	return (((addr >> 24) ^ base) & ~mask & 0xff) == 0;
+}
+
+/*
+	Finds the descriptors used for addr, for both user and supervisor accesses.
+	Returns the number of descriptors found, or -1 if the address can't be protected.
+*/
+short FindProtectableDescriptors(unsigned int addr, unsigned int** descs, unsigned int* starts, unsigned int* sizes)
+{
+	unsigned int regs[NUM_MMU_REGISTERS];
+	MmuGetRegisters(regs);
+	unsigned int tc = regs[MMU_TC];
+	if ((tc & TC_E) == 0 || (tc & TC_FCL) != 0 ||
+		TransparentlyTranslated(regs[MMU_TT0], addr) || TransparentlyTranslated(regs[MMU_TT1], addr))
+	{
+		return -1;
+	}
+	unsigned int tpaStart = (unsigned int)inferiorBasePage->p_lowtpa;
+	unsigned int tpaEnd = (unsigned int)inferiorBasePage->p_hitpa;
+	unsigned int sp = GetRegisters()->sp;
+	// The exception frame sits on the supervisor stack, which differs from sp in user mode.
+	// A protected page there would fault the next exception frame write into a double bus fault.
+	unsigned int ssp = (unsigned int)GetExceptionFrame();
+	short num = (tc & TC_SRE) != 0 ? 2 : 1;
+	for (short i = 0; i < num; ++i)
+	{
+		descs[i] = FindDescriptor(&regs[i == 0 ? MMU_CRP : MMU_SRP], tc, addr, &starts[i], &sizes[i]);
+		if (descs[i] == 0 || (descs[i][0] & DESC_WP) != 0 ||
+			starts[i] < tpaStart || (starts[i] + sizes[i]) > tpaEnd ||
+			(sp >= starts[i] && sp < (starts[i] + sizes[i])) ||
+			(ssp >= starts[i] && ssp < (starts[i] + sizes[i])))
+		{
+			return -1;
+		}
+	}
+	return num;
+}
+
+MmuPage* FindPage(unsigned int* descriptor)
+{
+	for (short i = 0; i < NUM_MMU_PAGES; ++i)
+	{
+		if (mmuPages[i].descriptor == descriptor)
+		{
+			return &mmuPages[i];
+		}
+	}
+	return 0;
+}
+
+bool MmuProtectRange(unsigned char* addr, unsigned int len)
+{
+	if (Cookie_CPU != 30 || inferiorBasePage == 0 || len == 0)
+	{
+		return false;
+	}
+	// A range can cross a page boundary, so check both ends.
+	unsigned int* descs[4];
+	unsigned int starts[4];
+	unsigned int sizes[4];
+	short num = FindProtectableDescriptors((unsigned int)addr, descs, starts, sizes);
+	if (num < 0)
+	{
+		return false;
+	}
+	short numEnd = FindProtectableDescriptors((unsigned int)addr + len - 1, descs + num, starts + num, sizes + num);
+	if (numEnd < 0)
+	{
+		return false;
+	}
+	num += numEnd;
+	// Both ends are often in the same page, and the user and supervisor trees may share tables.
+	short unique = 0;
+	for (short i = 0; i < num; ++i)
+	{
+		short j = 0;
+		while (j < unique && descs[j] != descs[i])
+		{
+			++j;
+		}
+		if (j == unique)
+		{
+			descs[unique] = descs[i];
+			starts[unique] = starts[i];
+			sizes[unique++] = sizes[i];
+		}
+	}
+	num = unique;
+	// Make sure all will fit before changing anything.
+	short needed = 0;
+	for (short i = 0; i < num; ++i)
+	{
+		if (FindPage(descs[i]) == 0)
+		{
+			++needed;
+		}
+	}
+	short available = 0;
+	for (short i = 0; i < NUM_MMU_PAGES; ++i)
+	{
+		if (mmuPages[i].descriptor == 0)
+		{
+			++available;
+		}
+	}
+	if (needed > available)
+	{
+		return false;
+	}
+	for (short i = 0; i < num; ++i)
+	{
+		MmuPage* page = FindPage(descs[i]);
+		if (page == 0)
+		{
+			page = FindPage(0);
+			page->descriptor = descs[i];
+			page->start = starts[i];
+			page->size = sizes[i];
+			page->refs = 0;
+		}
+		++page->refs;
+	}
+	return true;
+}
+
+void MmuUnprotectRange(unsigned char* addr, unsigned int len)
+{
+	if (Cookie_CPU != 30 || len == 0)
+	{
+		return;
+	}
+	unsigned int first = (unsigned int)addr;
+	unsigned int last = first + len - 1;
+	for (short i = 0; i < NUM_MMU_PAGES; ++i)
+	{
+		MmuPage* page = &mmuPages[i];
+		unsigned int end = page->start + page->size;
+		if (page->descriptor != 0 &&
+			((first >= page->start && first < end) || (last >= page->start && last < end)))
+		{
+			if (--page->refs == 0)
+			{
+				page->descriptor = 0;
+			}
+		}
+	}
+}
+
+void MmuDiscardAll(void)
+{
+	MmuApplyProtection(false);
+	for (short i = 0; i < NUM_MMU_PAGES; ++i)
+	{
+		mmuPages[i].descriptor = 0;
+	}
+	mmuSuspended = false;
+}
+
+bool MmuIsProtected(unsigned int addr)
+{
+	for (short i = 0; i < NUM_MMU_PAGES; ++i)
+	{
+		MmuPage* page = &mmuPages[i];
+		if (page->descriptor != 0 && addr >= page->start && addr < (page->start + page->size))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void MmuApplyProtection(bool on)
+{
+	if (on && mmuSuspended)
+	{
+		mmuSuspended = false;
+		return;
+	}
+	bool changed = false;
+	if (mmuProtecting)
+	{
+		// Pages are only added and removed in the server context, when protection is off.
+		for (short i = 0; i < NUM_MMU_PAGES; ++i)
+		{
+			if (mmuPages[i].descriptor != 0)
+			{
+				*mmuPages[i].descriptor &= ~DESC_WP;
+			}
+		}
+		mmuProtecting = false;
+		changed = true;
+	}
+	if (on)
+	{
+		for (short i = 0; i < NUM_MMU_PAGES; ++i)
+		{
+			if (mmuPages[i].descriptor != 0)
+			{
+				*mmuPages[i].descriptor |= DESC_WP;
+				mmuProtecting = true;
+				changed = true;
+			}
+		}
+	}
+	if (changed)
+	{
+		MmuFlush();
+	}
+}
+
+void MmuSuspendProtection(void)
+{
+	mmuSuspended = true;
+}
@@ -0,0 +1,36 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+/*
+	Write protection of inferior memory using the 68030 mmu.
+	Supervisor mode is assumed for all functions!
+*/
+#ifndef MMU_DEFINED
+#define MMU_DEFINED
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Write protects the pages containing the range. Returns false if that can't be done.
+bool MmuProtectRange(unsigned char* addr, unsigned int len);
+void MmuUnprotectRange(unsigned char* addr, unsigned int len);
+void MmuDiscardAll(void);
+
+// Returns true if the address is in a page that we have write protected.
+bool MmuIsProtected(unsigned int addr);
+
+// Called by the context switching, protection is only active in the inferior context.
+void MmuApplyProtection(bool on);
+// Makes the next MmuApplyProtection(true) do nothing, so a faulted write can be rerun.
+void MmuSuspendProtection(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MMU_DEFINED
@@ -0,0 +1,506 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+#include <stdbool.h>
+#include "monitor.h"
+#include "console.h"
+#include "packet.h"
+#include "hex.h"
+#include "clib.h"
+#include "exceptions.h"
+#include "coverage.h"
+#include "file_io.h"
+#include "live.h"
+#include "inferior.h"
+#include "timing.h"
+#include "log.h"
+#include "packet_trace.h"
+
+/*
+	Command output is written to the console and sent as 'O' packets before the final OK.
+	To add a command, add a function and an entry in monitorCommands.
+*/
+typedef struct
+{
+	const char* name;
+	void (*func)(char* args);
+	const char* help;
+} MonitorCommand;
+
+void MonitorHelp(char* args);
+void MonitorFlush(char* args);
+void MonitorIgnore(char* args);
+void MonitorBpStats(char* args);
+void MonitorCoverage(char* args);
+void MonitorSample(char* args);
+void MonitorTime(char* args);
+void MonitorLog(char* args);
+void MonitorPackets(char* args);
+
+const MonitorCommand monitorCommands[] =
+{
+	{"help",	MonitorHelp,	"help                    - List monitor commands.\n"},
+	{"flush",	MonitorFlush,	"flush                   - Send buffered dprintf output now.\n"},
+	{"ignore",	MonitorIgnore,	"ignore ADDR COUNT       - Continue past the breakpoint at ADDR COUNT times on the target.\n"},
+	{"bpstats",	MonitorBpStats,	"bpstats [clear]         - List breakpoint hit counters, or clear them.\n"},
+	{"coverage",	MonitorCoverage,	"coverage load FILE      - Plant one-shot traps at the hex text offsets in FILE.\n"
+							"coverage dump           - Show the hit bitmap, in ascending offset order.\n"
+							"coverage stop           - Remove the traps that haven't been hit.\n"},
+	{"sample",	MonitorSample,	"sample ADDR,LEN,... rate=N - Send the ranges N times a second while running.\n"
+							"sample stop             - Stop sending.\n"},
+	{"time",	MonitorTime,	"time from=ADDR to=ADDR [passes=N] - Time the code between ADDR:s on the target.\n"
+							"time [stop]             - Show min/avg/max, and stop timing.\n"},
+	{"log",		MonitorLog,		"log flush               - Write the buffered debug log now.\n"},
+	{"packets",	MonitorPackets,	"packets start|stop      - Clear and start, or stop, the timestamped packet trace.\n"
+							"packets                 - Show where the time went for the traced packets.\n"},
+	{0, 0, 0}
+};
+
+void MonitorHelp(char* args)
+{
+	for (const MonitorCommand* cmd = monitorCommands; cmd->name != 0; ++cmd)
+	{
+		ConsolePutString(cmd->help);
+	}
+}
+
+void MonitorFlush(char* args)
+{
+	// All output is flushed after any monitor command, so nothing more to do here.
+}
+
+/*
+	Parses a decimal number, or a hex number with a 0x prefix, and skips a comma and the spaces after it.
+	Returns false if there is no number.
+*/
+bool ParseNumber(char** args, unsigned int* value)
+{
+	char* ptr = *args;
+	unsigned int v = 0;
+	if (ptr[0] == '0' && (ptr[1] == 'x' || ptr[1] == 'X'))
+	{
+		ptr += 2;
+		char c;
+		while (((c = *ptr) >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))
+		{
+			v = (v << 4) | (unsigned int)HexToNibble(c);
+			++ptr;
+		}
+	}
+	else
+	{
+		while (*ptr >= '0' && *ptr <= '9')
+		{
+			v = (v * 10) + (unsigned int)(*ptr++ - '0');
+		}
+	}
+	if (ptr == *args || (*ptr != ' ' && *ptr != ',' && *ptr != 0))
+	{
+		return false;
+	}
+	if (*ptr == ',')
+	{
+		++ptr;
+	}
+	while (*ptr == ' ')
+	{
+		++ptr;
+	}
+	*args = ptr;
+	*value = v;
+	return true;
+}
+
+void MonitorIgnore(char* args)
+{
+	unsigned int addr, count;
+	if (!ParseNumber(&args, &addr) || !ParseNumber(&args, &count))
+	{
+		ConsolePutString("Usage: monitor ignore ADDR COUNT\n");
+	}
+	else if (SetBreakpointIgnore((unsigned short*)addr, count) != 0)
+	{
+		ConsolePutString("No room for more breakpoint counters.\n");
+	}
+}
+
+void MonitorBpStats(char* args)
+{
+	if (StringCompare("clear", args) > 0)
+	{
+		ClearBreakpointStats();
+		return;
+	}
+	unsigned int addr, hits, ignore;
+	for (short i = 0; GetBreakpointStats(i, &addr, &hits, &ignore); ++i)
+	{
+		if (addr != 0)
+		{
+			ConsolePutString("0x");
+			ConsolePutHex(addr);
+			ConsolePutString(" hits ");
+			ConsolePutDecimal(hits);
+			ConsolePutString(" ignore ");
+			ConsolePutDecimal(ignore);
+			ConsolePutChar('\n');
+		}
+	}
+}
+
+void MonitorCoverage(char* args)
+{
+	short end;
+	if ((end = StringCompare("load ", args)) > 0)
+	{
+		char* fileName = args + end;
+		while (*fileName == ' ')
+		{
+			++fileName;
+		}
+		VfileFixPath(fileName);
+		short n = CoverageLoad(fileName);
+		if (n < 0)
+		{
+			ConsolePutString("Could not load the offsets, is the inferior loaded?\n");
+			return;
+		}
+		ConsolePutDecimal((unsigned int)n);
+		ConsolePutString(" traps planted.\n");
+	}
+	else if (StringCompare("dump", args) > 0)
+	{
+		short count = CoverageCount();
+		short hits = 0;
+		unsigned char bits = 0;
+		for (short i = 0; i < count; ++i)
+		{
+			if (CoverageIsHit(i))
+			{
+				++hits;
+				bits |= (unsigned char)(0x80 >> (i & 7));
+			}
+			if ((i & 7) == 7 || i == count - 1)
+			{
+				ConsolePutChar(NibbleToHex(bits >> 4));
+				ConsolePutChar(NibbleToHex(bits));
+				bits = 0;
+				if ((i & 255) == 255 || i == count - 1)
+				{
+					ConsolePutChar('\n');
+				}
+			}
+		}
+		ConsolePutDecimal((unsigned int)hits);
+		ConsolePutChar('/');
+		ConsolePutDecimal((unsigned int)count);
+		ConsolePutString(" covered.\n");
+	}
+	else if (StringCompare("stop", args) > 0)
+	{
+		CoverageStop();
+	}
+	else
+	{
+		ConsolePutString("Usage: monitor coverage load FILE|dump|stop\n");
+	}
+}
+
+void MonitorSample(char* args)
+{
+	if (StringCompare("stop", args) > 0)
+	{
+		LiveSampleStop();
+		return;
+	}
+	if (inferiorState != RUNNING)
+	{
+		ConsolePutString("The inferior must be started first.\n");
+		return;
+	}
+	LiveRange ranges[LIVE_MAX_RANGES];
+	short n = 0;
+	unsigned int total = 0;
+	unsigned int addr, len, rate = 0;
+	short end;
+	while (*args != 0)
+	{
+		if ((end = StringCompare("rate=", args)) > 0)
+		{
+			args += end;
+			if (!ParseNumber(&args, &rate))
+			{
+				break;
+			}
+		}
+		else if (n < LIVE_MAX_RANGES && ParseNumber(&args, &addr) && ParseNumber(&args, &len) && len > 0 && len < 256)
+		{
+			ranges[n].addr = (unsigned char*)addr;
+			ranges[n].len = (unsigned char)len;
+			total += len;
+			++n;
+		}
+		else
+		{
+			break;
+		}
+	}
+	if (*args != 0 || n == 0 || rate == 0)
+	{
+		ConsolePutString("Usage: monitor sample ADDR,LEN,... rate=N\n");
+		return;
+	}
+	if (total > LIVE_SAMPLE_SIZE)
+	{
+		ConsolePutString("At most 128 bytes can be sampled.\n");
+		return;
+	}
+	for (short i = 0; i < n; ++i)
+	{
+		liveRanges[i] = ranges[i];
+	}
+	numLiveRanges = n;
+	if (!LiveSampleStart((unsigned short)(rate > LIVE_TICK_RATE ? 0 : rate)))
+	{
+		ConsolePutString("Could not start, rate is 1-960, timer A must be free and AUX used.\n");
+		return;
+	}
+	// Each byte takes a tick, so the rate the link can keep up with is lower.
+	unsigned int packetLength = 8 + 8 + 1 + total * 2 + 3;
+	if (packetLength * rate > LIVE_TICK_RATE)
+	{
+		ConsolePutString("Warning: the link can only send ");
+		ConsolePutDecimal(LIVE_TICK_RATE / packetLength);
+		ConsolePutString(" samples a second.\n");
+	}
+}
+
+void PutMicroseconds(unsigned int ticks)
+{
+	// 1 tick is 10000/6144 us, split to not overflow.
+	unsigned int us = (ticks / 384) * 625 + ((ticks % 384) * 625) / 384;
+	ConsolePutDecimal(us);
+	ConsolePutString("us (");
+	ConsolePutDecimal(ticks);
+	ConsolePutString(" ticks)");
+}
+
+void MonitorTime(char* args)
+{
+	short end;
+	if (*args == 0 || StringCompare("stop", args) > 0)
+	{
+		if (*args != 0)
+		{
+			TimeStop();
+		}
+		unsigned int passes, min, avg, max;
+		if (!TimeResult(&passes, &min, &avg, &max))
+		{
+			ConsolePutString(TimeActive() ? "No finished pass yet.\n" : "Nothing timed.\n");
+			return;
+		}
+		ConsolePutDecimal(passes);
+		ConsolePutString(" passes\nmin ");
+		PutMicroseconds(min);
+		ConsolePutString("\navg ");
+		PutMicroseconds(avg);
+		ConsolePutString("\nmax ");
+		PutMicroseconds(max);
+		ConsolePutChar('\n');
+		return;
+	}
+	unsigned int from = 0, to = 0, passes = 0;
+	while (*args != 0)
+	{
+		unsigned int* value;
+		if ((end = StringCompare("from=", args)) > 0)
+		{
+			value = &from;
+		}
+		else if ((end = StringCompare("to=", args)) > 0)
+		{
+			value = &to;
+		}
+		else if ((end = StringCompare("passes=", args)) > 0)
+		{
+			value = &passes;
+		}
+		else
+		{
+			break;
+		}
+		args += end;
+		if (!ParseNumber(&args, value))
+		{
+			break;
+		}
+	}
+	if (*args != 0 || from == 0 || to == 0)
+	{
+		ConsolePutString("Usage: monitor time from=ADDR to=ADDR [passes=N]\n");
+	}
+	else if (inferiorState != RUNNING)
+	{
+		ConsolePutString("The inferior must be started first.\n");
+	}
+	else if (!TimeStart((unsigned short*)from, (unsigned short*)to, passes))
+	{
+		ConsolePutString("Could not start, the addresses must be in the inferior and timer B free.\n");
+	}
+}
+
+void MonitorLog(char* args)
+{
+	if (StringCompare("flush", args) > 0)
+	{
+		LogFlush();
+	}
+	else
+	{
+		ConsolePutString("Usage: monitor log flush\n");
+	}
+}
+
+void PutTraceTicks(unsigned int ticks)
+{
+	// 1 tick is 625/24 us, split to not overflow.
+	ConsolePutChar(' ');
+	ConsolePutDecimal((ticks / 24) * 625 + ((ticks % 24) * 625) / 24);
+}
+
+// Prints the time between two trace stamps in us, or '-' if the second never happened.
+void PutTraceTime(unsigned int from, unsigned int to)
+{
+	if (to == 0)
+	{
+		ConsolePutString(" -");
+		return;
+	}
+	PutTraceTicks(to - from);
+}
+
+void MonitorPackets(char* args)
+{
+	if (StringCompare("start", args) > 0)
+	{
+		PacketTraceStart();
+		return;
+	}
+	if (StringCompare("stop", args) > 0)
+	{
+		PacketTraceStop();
+		return;
+	}
+	if (*args != 0)
+	{
+		ConsolePutString("Usage: monitor packets [start|stop]\n");
+		return;
+	}
+	PacketRecord r;
+	if (!PacketTraceGet(0, &r))
+	{
+		ConsolePutString(PacketTraceActive() ? "No packets traced yet.\n" : "Nothing traced, start with \"monitor packets start\".\n");
+		return;
+	}
+	/*
+		gap is from the previous reply to the start of the packet, the time spent in gdb and on the link.
+		rx is receiving the packet, cpu is handling it, tx is sending the reply and waiting for the ack.
+		The reply to s and c is the stop, so their tx is the time the inferior ran.
+	*/
+	ConsolePutString("pkt len in out gap rx cpu tx (us)\n");
+	unsigned int previous = 0;
+	unsigned int totalIn = 0, totalOut = 0;
+	unsigned int totalGap = 0, totalRx = 0, totalCpu = 0, totalTx = 0;
+	short n = 0;
+	for (; PacketTraceGet(n, &r); ++n)
+	{
+		for (short i = 0; i < 2; ++i)
+		{
+			char c = r.type[i];
+			ConsolePutChar(c >= ' ' && c < 0x7f ? c : '.');
+		}
+		ConsolePutChar(' ');
+		ConsolePutDecimal(r.length);
+		ConsolePutChar(' ');
+		ConsolePutDecimal(r.wireIn);
+		ConsolePutChar(' ');
+		ConsolePutDecimal(r.wireOut);
+		PutTraceTime(previous, previous != 0 ? r.receiveStart : 0);
+		PutTraceTime(r.receiveStart, r.receiveEnd);
+		PutTraceTime(r.receiveEnd, r.handled);
+		PutTraceTime(r.handled, r.handled != 0 ? r.acked : 0);
+		ConsolePutChar('\n');
+		totalIn += r.wireIn;
+		totalOut += r.wireOut;
+		if (previous != 0)
+		{
+			totalGap += r.receiveStart - previous;
+		}
+		if (r.receiveEnd != 0)
+		{
+			totalRx += r.receiveEnd - r.receiveStart;
+			if (r.handled != 0)
+			{
+				totalCpu += r.handled - r.receiveEnd;
+				if (r.acked != 0)
+				{
+					totalTx += r.acked - r.handled;
+				}
+			}
+		}
+		previous = r.acked;
+		if ((n & 15) == 15)
+		{
+			// The console buffer only holds a few lines of this.
+			ConsoleFlush();
+		}
+	}
+	ConsolePutDecimal((unsigned int)n);
+	ConsolePutString(" packets, ");
+	ConsolePutDecimal(totalIn);
+	ConsolePutString(" bytes in, ");
+	ConsolePutDecimal(totalOut);
+	ConsolePutString(" bytes out\ntotal");
+	PutTraceTicks(totalGap);
+	PutTraceTicks(totalRx);
+	PutTraceTicks(totalCpu);
+	PutTraceTicks(totalTx);
+	ConsolePutChar('\n');
+}
+
+void CmdMonitor(char* hexCommand)
+{
+	HexConvertByteArray(hexCommand);
+	char* command = hexCommand;
+	while (*command == ' ')
+	{
+		++command;
+	}
+	const MonitorCommand* cmd = monitorCommands;
+	short len = 0;
+	for (; cmd->name != 0; ++cmd)
+	{
+		len = StringCompare(cmd->name, command);
+		if (len > 0 && (command[len] == ' ' || command[len] == 0))
+		{
+			break;
+		}
+	}
+	if (cmd->name != 0)
+	{
+		char* args = command + len;
+		while (*args == ' ')
+		{
+			++args;
+		}
+		cmd->func(args);
+	}
+	else
+	{
+		ConsolePutString("Unknown monitor command, try \"monitor help\".\n");
+	}
+	ConsoleFlush();
+	WriteOK();
+}
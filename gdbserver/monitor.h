@@ -0,0 +1,23 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+/*
+	gdb "monitor" commands, sent as qRcmd packets.
+*/
+#ifndef MONITOR_DEFINED
+#define MONITOR_DEFINED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Executes the hex encoded command and writes the response.
+void CmdMonitor(char* hexCommand);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MONITOR_DEFINED
@@ -11,10 +11,12 @@
 #include "exceptions.h"
 #include "gdb_defines.h"
 #include "target_xml.h"
+#include "memory_map.h"
 #include "cookies.h"
 #include "inferior.h"
 #include "context.h"
 #include "critical.h"
+#include "packet_trace.h"
 
 /*
 	Max inPacket and outPacket size must be the same, 
@@ -27,6 +29,18 @@ char	outPacket[PACKET_SIZE + 1] __attribute__((aligned(2)));
 
 bool	noAckMode = false;				// gdb QStartNoAckMode
 
+// Memory is copied through a buffer of this size, in m and M.
+#define MEMORY_CHUNK_SIZE	64
+
+/*
+	Hex image of the register file, laid out exactly like ExceptionRegisters with
+	8 hex digits per long. It is encoded once per stop and then serves all g, p and
+	stop replies until the inferior is resumed.
+*/
+#define NUM_REGISTER_LONGS	(sizeof(ExceptionRegisters) / 4)
+char	registerHex[NUM_REGISTER_LONGS * 8];
+short	registerHexLongs = 0;		// Number of longs currently encoded in registerHex.
+
 // server
 int CheckServerQuitKey(void);
 extern unsigned int numOfCpuRegisters;
@@ -56,17 +70,113 @@ void ClearOutPacket(void)
 	outPacketLength = 0;
 }
 
+// Number of longs in ExceptionRegisters that gdb knows about.
+short GetNumRegisterLongs(void)
+{
+	if ((Cookie_FPU & (0x1f << 16)) != 0)
+	{
+		return NUM_REGISTER_LONGS;
+	}
+	return 18;
+}
+
+// Converts a gdb register number into the first long index in ExceptionRegisters and the number of longs.
+short RegisterLongs(unsigned int idx, short* count)
+{
+	*count = 1;
+	if (idx < 18)
+	{
+		return (short)idx;
+	}
+	else if (idx >= (18 + 8))
+	{
+		return (short)(idx + 16);
+	}
+	*count = 3;
+	return (short)(18 + ((idx - 18) * 3));
+}
+
+// Converts a long index in ExceptionRegisters into a gdb register number bit.
+unsigned int RegisterBit(short longIdx)
+{
+	if (longIdx < 18)
+	{
+		return (unsigned int)1 << longIdx;
+	}
+	else if (longIdx >= 18 + (8 * 3))
+	{
+		return (unsigned int)1 << (longIdx - 16);
+	}
+	// fp0 - fp7 use three longs each. Counted down, as a division is slow on a 68000.
+	short reg = 18;
+	for (longIdx -= 18 + 3; longIdx >= 0; longIdx -= 3)
+	{
+		++reg;
+	}
+	return (unsigned int)1 << reg;
+}
+
+void InvalidateRegisterCache(void)
+{
+	registerHexLongs = 0;
+}
+
+/*
+	Makes sure that at least the first "longs" of the register file are encoded.
+	The fpu registers are saved lazily, so they are only fetched from the fpu when
+	gdb actually asks for them.
+*/
+void UpdateRegisterCache(short longs)
+{
+	if (registerHexLongs < longs)
+	{
+		if (longs > 18)
+		{
+			SaveFpuRegisters();
+		}
+		unsigned int* ptr = (unsigned int*)GetRegisters();
+		char* hexptr = &registerHex[registerHexLongs * 8];
+		for (short i = registerHexLongs; i < longs; ++i)
+		{
+			LongToHex(ptr[i], hexptr);
+			hexptr += 8;
+		}
+		registerHexLongs = longs;
+	}
+}
+
+void WriteCachedLongs(short first, short count)
+{
+	char* hexptr = &registerHex[first * 8];
+	for (short i = count * 8; i > 0; --i)
+	{
+		WriteChar(*hexptr++);
+	}
+}
+
+bool packetStarted = false;		// The '$' have already been read by the serial interrupt.
+
+void ReceiveStartedPacket(void)
+{
+	packetStarted = true;
+	ReceivePacket();
+}
+
 void ReceivePacket(void)
 {
 	DbgRemOut("ReceivePacket: \r\n");
 	int c;
 	bool waitForPacket = true;
+	bool traced = false;
+	short wireBytes = 0;		// Kept over retries, as the failed tries took time too.
 
 	while (waitForPacket)
 	{
 		unsigned char sum = 0;
 		inPacketLength = 0;
 		DbgRemOut("\tWaiting...\r\n");
+		// Nothing is timing critical while waiting for gdb.
+		LogFlush();
 		
 		// Wait for connection.
 		while (!comDev->IsConnected())
@@ -85,7 +195,7 @@ void ReceivePacket(void)
 		DbgRemOut("\tGot connection...\r\n");
 
 		// Wait for packet start
-		while ((c = GetByte()) != '$')
+		while (!packetStarted && (c = GetByte()) != '$')
 		{
 			if (c == COMM_ERR_DISCONNECTED)
 			{
@@ -103,6 +213,13 @@ void ReceivePacket(void)
 			}
 		}
 		
+		packetStarted = false;
+		if (!traced)
+		{
+			PacketTraceReceiveStart();
+			traced = true;
+		}
+		++wireBytes;
 		DbgRemOut("\tGot beginning of packet.\r\n");
 		// Fetch payload
 		bool escaped = false;
@@ -124,6 +241,7 @@ void ReceivePacket(void)
 				inPacket[0] = 0x1a;		// Ctrl-Z
 				return;
 			}
+			++wireBytes;
 			if (escaped)
 			{
 				sum += (unsigned char)c;
@@ -186,6 +304,7 @@ void ReceivePacket(void)
 		{
 			waitForPacket = false;
 		}
+		wireBytes += 2;
 		if (!comDev->IsConnected())
 		{
 			DbgRemOut("\r\n\tConnection dropped!\r\n");
@@ -194,6 +313,50 @@ void ReceivePacket(void)
 			return;
 		}
 	}
+	PacketTraceReceiveEnd(inPacket, inPacketLength, wireBytes);
+}
+
+int encodedBytes = 0;		// Bytes sent by PutEncoded, for the packet trace.
+
+// Sends data escaped, followed by the checksum if last is set. Returns the checksum so far.
+unsigned char PutEncoded(const char* data, int length, unsigned char sum, bool last)
+{
+	for (int i = 0; i < length; ++i)
+	{
+		char c = data[i];
+		if (c == '$' || c == '#' || c == '*' || c == 0x7d)
+		{
+			PutByte(0x7d);
+			++encodedBytes;
+			sum += 0x7d;
+			c ^= 0x20;
+		}
+		PutByte(c);
+		sum += (unsigned char)c;
+	}
+	if (last)
+	{
+		// End with checksum
+		PutByte('#');
+		PutByte(NibbleToHex(sum >> 4));
+		PutByte(NibbleToHex(sum));
+		encodedBytes += 3;
+	}
+	encodedBytes += length;
+	return sum;
+}
+
+void TransmitNotification(const char* name)
+{
+	DbgRemOut("TransmitNotification:\r\n\t");
+	if (!comDev->IsConnected())
+	{
+		return;
+	}
+	// Notifications are never acknowledged.
+	PutByte('%');
+	unsigned char sum = PutEncoded(name, (int)strlen(name), 0, false);
+	PutEncoded(outPacket, outPacketLength, sum, true);
 }
 
 void TransmitPacket(bool skipAck)
@@ -209,25 +372,9 @@ void TransmitPacket(bool skipAck)
 		return;
 	}
 	
-	unsigned char sum = 0;
-	// Send encoded
 	PutByte('$');	// Packets always start with $
-	for (int i = 0; i < outPacketLength; ++i)
-	{
-		char c = outPacket[i];
-		if (c == '$' || c == '#' || c == '*' || c == 0x7d)
-		{
-			PutByte(0x7d);
-			sum += 0x7d;
-			c ^= 0x20;
-		}
-		PutByte(c);
-		sum += (unsigned char)c;
-	}
-	// End with checksum
-	PutByte('#');
-	PutByte(NibbleToHex(sum >> 4));
-	PutByte(NibbleToHex(sum));
+	encodedBytes = 1;
+	PutEncoded(outPacket, outPacketLength, 0, true);
 
 	if (!noAckMode && !skipAck)
 	{
@@ -251,6 +398,7 @@ void TransmitPacket(bool skipAck)
 	{
 		DbgRemOut("\r\n");
 	}
+	PacketTraceSent((short)encodedBytes);
 }
 
 void WriteChar(char c)
@@ -320,7 +468,7 @@ short ReadNumber(short inOff, unsigned int* result)
 	while (offset < inPacketLength && inPacket[offset] != '=')
 	{
 		char c = inPacket[offset];
-		if (c == '=' || c == ',' || c == ':') { break; }
+		if (c == '=' || c == ',' || c == ':' || c == ';') { break; }
 		v = (v << 4) | (unsigned int)HexToNibble(c);
 		++offset;
 	}
@@ -446,22 +594,33 @@ void WriteFileResponse(int result, int ioErrno, const char* attachment)
 
 void WriteStop(int si_signo, int si_code, bool start_break)
 {
-	if (si_signo == GDB_SIGTRAP && si_code == TRAP_BRKPT)
+	if (si_signo == GDB_SIGTRAP && (si_code == TRAP_BRKPT || si_code == TRAP_WATCH))
 	{
-		// Software breakpoint hit.
+		// Software breakpoint hit, or watched memory changed.
 		WriteChar('T');
 		WriteByte((unsigned char)si_signo);
-		unsigned int* ptr = (unsigned int*)GetRegisters();
-		if (!start_break)
+		if (si_code == TRAP_WATCH)
+		{
+			unsigned int addr = 0;
+			WriteString(GetTriggeredWatchpoint(&addr) == WATCH_ACCESS ? "awatch:" : "watch:");
+			WriteLong(addr);
+			WriteChar(';');
+		}
+		else if (!start_break)
 		{
 			WriteString("swbreak:;");
 		}
+		if (TakeInferiorTextChanged())
+		{
+			WriteString("textchanged:;");
+		}
 		// Report fp, sp, sr, pc
+		UpdateRegisterCache(18);
 		for (unsigned char i = 14; i <= 17; ++i)
 		{
 			WriteByte(i);
 			WriteChar(':');
-			WriteLong(ptr[i]);
+			WriteCachedLongs(i, 1);
 			WriteChar(';');
 		}
 	}
@@ -474,38 +633,43 @@ void WriteStop(int si_signo, int si_code, bool start_break)
 
 void ReadRegisters(void)
 {
-	unsigned int* ptr = (unsigned int*)GetRegisters();
-	size_t num = 18;
-	if ((Cookie_FPU & (0x1f << 16)) != 0)
-	{
-		num += (8*3) + 3;
-	}
-
-	for (size_t i = 0; i < num; ++i)
-	{
-		WriteLong(ptr[i]);
-	}
+	short num = GetNumRegisterLongs();
+	UpdateRegisterCache(num);
+	WriteCachedLongs(0, num);
 }
 
 void WriteRegisters(void)
 {
-	if (GetInPacketLength() != (sizeof(ExceptionRegisters) * 2) + 1)
+	short num = GetNumRegisterLongs();
+	if (GetInPacketLength() != (num * 8) + 1)
 	{
 		WriteError(1);
 	}
 	else
 	{
+		/*
+			gdb always sends the complete register file, even if only one register was changed.
+			Compare with the hex image from the stop, and only decode what differs.
+		*/
+		UpdateRegisterCache(num);
 		unsigned int* ptr = (unsigned int*)GetRegisters();
 		char* buf = GetInpacketPtr(1);
-		size_t num = 18;
-		if ((Cookie_FPU & (0x1f << 16)) != 0)
-		{
-			num += (8*3) + 3;
-		}
-		for (size_t i = 0; i < num; ++i)
+		char* hexptr = registerHex;
+		for (short i = 0; i < num; ++i)
 		{
-			ptr[i] = HexToLong(buf);
+			short c = 0;
+			while (c < 8 && buf[c] == hexptr[c])
+			{
+				++c;
+			}
+			if (c != 8)
+			{
+				ptr[i] = HexToLong(buf);
+				LongToHex(ptr[i], hexptr);
+				registersDirty |= RegisterBit(i);
+			}
 			buf += 8;
+			hexptr += 8;
 		}
 		WriteOK();
 	}
@@ -524,22 +688,23 @@ void WriteRegister(void)
 			if (*inptr == '=')
 			{
 				++inptr;
-				if (idx < 18)
+				short count;
+				short first = RegisterLongs(idx, &count);
+				if (idx >= 18)
 				{
-					rptr[idx] = HexToLong(inptr);
+					// The fpu registers must be saved before they can be written back.
+					SaveFpuRegisters();
 				}
-				else if (idx >= (18 + 8))
+				for (short i = 0; i < count; ++i)
 				{
-					idx += 16;
-					rptr[idx] = HexToLong(inptr);
-				}
-				else
-				{
-					idx = 18 + ((idx - 18) * 3);
-					rptr[idx] = HexToLong(inptr);
-					rptr[idx + 1] = HexToLong(inptr + 8);
-					rptr[idx + 2] = HexToLong(inptr + 16);
+					rptr[first + i] = HexToLong(inptr);
+					if ((first + i) < registerHexLongs)
+					{
+						LongToHex(rptr[first + i], &registerHex[(first + i) * 8]);
+					}
+					inptr += 8;
 				}
+				registersDirty |= (unsigned int)1 << idx;
 			}
 		}
 		else
@@ -553,28 +718,15 @@ void WriteRegister(void)
 
 void ReadRegister(void)
 {
-	unsigned int* rptr = (unsigned int*)GetRegisters();
 	unsigned int idx;
 	if (ReadNumber(1, &idx) > 0)
 	{
 		if (idx < numOfCpuRegisters)
 		{
-			if (idx < 18)
-			{
-				WriteLong(rptr[idx]);
-			}
-			else if (idx >= (18 + 8))
-			{
-				idx += 16;
-				WriteLong(rptr[idx]);
-			}
-			else
-			{
-				idx = 18 + ((idx - 18) * 3);
-				WriteLong(rptr[idx]);
-				WriteLong(rptr[idx + 1]);
-				WriteLong(rptr[idx + 2]);
-			}
+			short count;
+			short first = RegisterLongs(idx, &count);
+			UpdateRegisterCache(first + count);
+			WriteCachedLongs(first, count);
 		}
 		/*
 		else
@@ -585,7 +737,10 @@ void ReadRegister(void)
 	}
 }
 
-void WriteTargetXML(short vNameEnd)
+/*
+	Answers a qXfer read of "offset,length" from a document made of null terminated parts.
+*/
+void WriteXfer(short vNameEnd, const char* parts[], unsigned int xml_len)
 {
 	unsigned char* addr;
 	unsigned int len;
@@ -593,9 +748,6 @@ void WriteTargetXML(short vNameEnd)
 	{
 		unsigned int offset = (unsigned int)addr;
 		
-		const char* xmls[5];
-		unsigned int xml_len = GetTargetXml(xmls);
-		
 		unsigned int maxRead = (PACKET_SIZE - 20);	// max packet size - some room for response
 		if ((offset + len) > xml_len)
 		{
@@ -611,12 +763,15 @@ void WriteTargetXML(short vNameEnd)
 		{
 			// Too much for one packet, only send a part of it.
 			WriteChar('m');
-			len = maxRead;
+			if (len > maxRead)
+			{
+				len = maxRead;
+			}
 		}
 
 		const char* xml;
 		int ix = 0;
-		while ((xml = xmls[ix++]) != 0 && len != 0)
+		while ((xml = parts[ix++]) != 0 && len != 0)
 		{
 			unsigned int slen = strlen(xml);
 			if (offset >= slen)
@@ -639,6 +794,20 @@ void WriteTargetXML(short vNameEnd)
 	}
 }
 
+void WriteTargetXML(short vNameEnd)
+{
+	const char* xmls[5];
+	unsigned int xml_len = GetTargetXml(xmls);
+	WriteXfer(vNameEnd, xmls, xml_len);
+}
+
+void WriteMemoryMap(short vNameEnd)
+{
+	const char* xmls[4];
+	unsigned int xml_len = GetMemoryMapXml(xmls);
+	WriteXfer(vNameEnd, xmls, xml_len);
+}
+
 void WriteOffsets(void)
 {
 	if (inferiorBasePage != NULL)	// Return empty if no inferior
@@ -647,7 +816,7 @@ void WriteOffsets(void)
 		unsigned int dataoffset = (unsigned int)(inferiorBasePage->p_dbase);
 		WriteNameAndLong("TextSeg", textoffset);
 		WriteChar(';');
-		if (inferior_is_mintelf)
+		if (inferiorToolchain == TOOLCHAIN_MINTELF)
 		{
 			// m68k-atari-mintelf toolchain produces data symbols that use the
 			// data segment as base.
@@ -670,12 +839,19 @@ void WriteMemory(bool isSupervisorMode)
 	if (isSupervisorMode && offset > 0)
 	{
 		char* ptr = GetInpacketPtr(offset);
-		for (unsigned int i = 0; i < len; ++i)
+		unsigned char buf[MEMORY_CHUNK_SIZE];
+		for (unsigned int done = 0; done < len; done += MEMORY_CHUNK_SIZE)
 		{
-			unsigned char* infAddr = InferiorContextMemoryAddress(addr + i);
-			ExceptionSafeMemoryWrite(infAddr, HexToByte(ptr));
-			ptr += 2;
+			unsigned int n = len - done < MEMORY_CHUNK_SIZE ? len - done : MEMORY_CHUNK_SIZE;
+			for (unsigned int i = 0; i < n; ++i)
+			{
+				buf[i] = HexToByte(ptr);
+				ptr += 2;
+			}
+			WriteInferiorMemory(addr + done, buf, n);
 		}
+		// The written memory might be code.
+		RequestCacheClear(CACHE_INSTRUCTION);
 	}
 	else
 	{
@@ -690,12 +866,15 @@ void ReadMemory(bool isSupervisorMode)
 	short offset = GetAddressAndLength(1, false, &addr, &len);
 	if (isSupervisorMode && offset > 0)
 	{
-		for (unsigned int i = 0; i < len; ++i)
+		unsigned char buf[MEMORY_CHUNK_SIZE];
+		for (unsigned int done = 0; done < len; done += MEMORY_CHUNK_SIZE)
 		{
-			unsigned char* infAddr = InferiorContextMemoryAddress(addr + i);
-			unsigned char membyte;
-			ExceptionSafeMemoryRead(infAddr, &membyte);
-			WriteByte(membyte);
+			unsigned int n = len - done < MEMORY_CHUNK_SIZE ? len - done : MEMORY_CHUNK_SIZE;
+			ReadInferiorMemory(addr + done, buf, n);
+			for (unsigned int i = 0; i < n; ++i)
+			{
+				WriteByte(buf[i]);
+			}
 		}
 	}
 	else
@@ -19,7 +19,11 @@ short GetOutPacketLength(void);
 void ClearOutPacket(void);
 
 void ReceivePacket(void);
+// Receives a packet when the '$' have already been read.
+void ReceiveStartedPacket(void);
 void TransmitPacket(bool skipAck);
+// Sends the out packet as a "%name..." notification.
+void TransmitNotification(const char* name);
 
 void WriteChar(char c);
 short GetHexString(short offset, char** strOut);
@@ -35,11 +39,15 @@ void GetInferiorNameAndArgs(short vNameEnd, char* inferior_filename, char* infer
 void WriteVariable(int val);
 void WriteFileResponse(int result, int ioErrno, const char* attachment);
 void WriteStop(int si_signo, int si_code, bool start_break);
+short GetNumRegisterLongs(void);
+short RegisterLongs(unsigned int idx, short* count);
+void InvalidateRegisterCache(void);
 void ReadRegisters(void);
 void WriteRegisters(void);
 void WriteRegister(void);
 void ReadRegister(void);
 void WriteTargetXML(short vNameEnd);
+void WriteMemoryMap(short vNameEnd);
 void WriteOffsets(void);
 void WriteMemory(bool isSupervisorMode);
 void ReadMemory(bool isSupervisorMode);
@@ -0,0 +1,136 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+#include <stdbool.h>
+#include "packet_trace.h"
+#include "inferior.h"
+#include "bios_calls.h"
+
+/*
+	The server runs in supervisor mode while an inferior is running, and in user mode between
+	inferiors, where the counters are read with Supexec.
+	A timer C wrap that haven't been counted in _hz_200 yet is seen as pending in IPRB.
+*/
+#define SYSVAR_HZ_200		((volatile unsigned int*)0x4ba)
+#define MFP_TCDR			((volatile unsigned char*)0xfffffa23)
+#define MFP_IPRB			((volatile unsigned char*)0xfffffa0d)
+#define MFP_TIMER_C_BIT		0x20
+#define TIMER_C_COUNT		192
+
+PacketRecord packetRecords[PACKET_TRACE_RECORDS];
+unsigned int packetRecordCount = 0;		// Records made since start, the latest is the current.
+bool packetTraceActive = false;
+bool packetReceiving = false;			// A record have been started.
+
+#pragma GCC diagnostic push
+// Remove out of bounds warning, as the system variable read will trigger false warnings.
+#pragma GCC diagnostic ignored "-Warray-bounds="
+
+int PacketTraceNow_super(void)
+{
+	unsigned int hz = *SYSVAR_HZ_200;
+	unsigned char count = *MFP_TCDR;
+	if (*SYSVAR_HZ_200 != hz)
+	{
+		// Wrapped between the reads.
+		hz = *SYSVAR_HZ_200;
+		count = *MFP_TCDR;
+	}
+	if ((*MFP_IPRB & MFP_TIMER_C_BIT) != 0)
+	{
+		++hz;
+		count = *MFP_TCDR;
+	}
+	return (int)(hz * TIMER_C_COUNT + (unsigned int)(TIMER_C_COUNT - count));
+}
+
+#pragma GCC diagnostic pop
+
+unsigned int PacketTraceNow(void)
+{
+	return (unsigned int)(inferiorState == RUNNING ? PacketTraceNow_super() : Supexec(PacketTraceNow_super));
+}
+
+PacketRecord* CurrentRecord(void)
+{
+	return &packetRecords[(packetRecordCount - 1) % PACKET_TRACE_RECORDS];
+}
+
+void PacketTraceStart(void)
+{
+	packetRecordCount = 0;
+	packetReceiving = false;
+	packetTraceActive = true;
+}
+
+void PacketTraceStop(void)
+{
+	packetTraceActive = false;
+}
+
+bool PacketTraceActive(void)
+{
+	return packetTraceActive;
+}
+
+bool PacketTraceGet(short idx, PacketRecord* record)
+{
+	unsigned int first = packetRecordCount > PACKET_TRACE_RECORDS ? packetRecordCount - PACKET_TRACE_RECORDS : 0;
+	if (idx < 0 || first + (unsigned int)idx >= packetRecordCount)
+	{
+		return false;
+	}
+	*record = packetRecords[(first + (unsigned int)idx) % PACKET_TRACE_RECORDS];
+	return true;
+}
+
+void PacketTraceReceiveStart(void)
+{
+	if (!packetTraceActive)
+	{
+		return;
+	}
+	++packetRecordCount;
+	PacketRecord* r = CurrentRecord();
+	r->receiveStart = PacketTraceNow();
+	r->receiveEnd = 0;
+	r->handled = 0;
+	r->acked = 0;
+	r->wireOut = 0;
+	packetReceiving = true;
+}
+
+void PacketTraceReceiveEnd(const char* payload, short length, short wireBytes)
+{
+	if (!packetTraceActive || !packetReceiving)
+	{
+		return;
+	}
+	PacketRecord* r = CurrentRecord();
+	r->receiveEnd = PacketTraceNow();
+	r->type[0] = length > 0 ? payload[0] : ' ';
+	r->type[1] = length > 1 ? payload[1] : ' ';
+	r->length = (unsigned short)length;
+	r->wireIn = (unsigned short)wireBytes;
+}
+
+void PacketTraceHandled(void)
+{
+	if (packetTraceActive && packetReceiving)
+	{
+		CurrentRecord()->handled = PacketTraceNow();
+	}
+}
+
+void PacketTraceSent(short wireBytes)
+{
+	if (packetTraceActive && packetReceiving)
+	{
+		PacketRecord* r = CurrentRecord();
+		r->acked = PacketTraceNow();
+		r->wireOut = (unsigned short)wireBytes;
+		packetReceiving = false;
+	}
+}
@@ -0,0 +1,56 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+/*
+	Timestamped trace of the gdb packets, shown with "monitor packets".
+	Every packet gets a record with its first two characters, payload length, the bytes on
+	the wire in both directions, and the times when it started to arrive, when it was received,
+	when the reply was ready and when the reply was acked. The records show if the time goes
+	to the serial link, to the handlers, or to gdb between packets.
+	Time is taken from _hz_200 and the MFP timer C counter, that TOS runs at 200 Hz with a
+	count of 192, which gives PACKET_TRACE_RATE ticks a second without claiming a timer.
+*/
+#ifndef PACKET_TRACE_DEFINED
+#define PACKET_TRACE_DEFINED
+
+#include <stdbool.h>
+
+#define PACKET_TRACE_RECORDS	128		// The latest are kept.
+#define PACKET_TRACE_RATE		38400
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+	char			type[2];		// First two characters of the payload.
+	unsigned short	length;			// Payload length, unescaped.
+	unsigned short	wireIn;			// Bytes received for the packet, with framing and escapes.
+	unsigned short	wireOut;		// Bytes sent for the reply, 0 if there was none.
+	unsigned int	receiveStart;	// The '$' arrived.
+	unsigned int	receiveEnd;		// The checksum was checked and acked.
+	unsigned int	handled;		// The reply was ready, 0 if never.
+	unsigned int	acked;			// The reply was sent and acked, 0 if never.
+} PacketRecord;
+
+// Clears the trace and starts recording.
+void PacketTraceStart(void);
+void PacketTraceStop(void);
+bool PacketTraceActive(void);
+// Returns the idx:th oldest record, false when there is no such record.
+bool PacketTraceGet(short idx, PacketRecord* record);
+
+// Called by ReceivePacket, TransmitPacket and ServerCommandLoop.
+void PacketTraceReceiveStart(void);
+void PacketTraceReceiveEnd(const char* payload, short length, short wireBytes);
+void PacketTraceHandled(void);
+void PacketTraceSent(short wireBytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PACKET_TRACE_DEFINED
@@ -7,9 +7,7 @@
 	To add/change support for hardware memory registers, look at:
 		
 		context.c:
-		StoreMemoryRegisters
-		RestoreMemoryRegisters
-		InferiorContextMemoryAddress
+		shadowRanges
 */
 
 // Don't use when serial communication, it's not good enough.
@@ -31,6 +29,14 @@
 #include "packet.h"
 #include "cookies.h"
 #include "inferior.h"
+#include "agent.h"
+#include "console.h"
+#include "monitor.h"
+#include "tracepoint.h"
+#include "live.h"
+#include "timing.h"
+#include "memory_map.h"
+#include "packet_trace.h"
 
 typedef enum
 {
@@ -46,13 +52,14 @@ typedef enum
 #define USERCODE_ERROR		-1
 #define USERCODE_WARNING	-2
 
-const char serverFeatures[] = "PacketSize=3ff;swbreak+"
+const char serverFeatures[] = "PacketSize=3ff;swbreak+;ConditionalBreakpoints+;BreakpointCommands+;ConditionalTracepoints+;TracepointSource+"
 	#ifdef QStartNoAckMode
 	";QStartNoAckMode+"
 	#endif
 	#ifdef qXfer_features
 	";qXfer:features:read+"
 	#endif
+	";qXfer:memory-map:read+"
 	;
 
 /*
@@ -65,6 +72,7 @@ bool	option_multi = false;
 bool	run_once = false;										// If set and if extended mode, then gdbserver exits when inferior is killed.
 int		userCodeForCommandLoop = USERCODE_SILENT;				// Used as si_code when calling ServerCommandLoop.
 int		userCodeIfError = USERCODE_ERROR;						// Will be copied to userCodeForCommandLoop if inferior loading fails.
+bool	nonStopMode = false;									// gdb non-stop mode, stops are sent as notifications.
 
 unsigned int	numOfCpuRegisters	=	18;
 
@@ -151,6 +159,10 @@ void CmdQuery(void)
 {
 	short vNameEnd;
 	char* inptr = GetInpacketPtr(0);
+	if (CmdTracepoint())
+	{
+		return;
+	}
 	if (StringCompare("qOffsets", inptr) > 0)
 	{
 		WriteOffsets();
@@ -165,6 +177,12 @@ void CmdQuery(void)
 		noAckMode = true;
 		WriteOK();
 	}
+	else if ((vNameEnd = StringCompare("QNonStop:", inptr)) > 0)
+	{
+		nonStopMode = inptr[vNameEnd] == '1';
+		EnablePacketBreak(nonStopMode);
+		WriteOK();
+	}
 	else if ((vNameEnd = StringCompare("QSetWorkingDir:", inptr)) > 0)
 	{
 		CmdSetWorkingDir(vNameEnd);
@@ -177,18 +195,92 @@ void CmdQuery(void)
 	{
 		WriteError(0);
 	}
+	else if ((vNameEnd = StringCompare("qXfer:memory-map:read::", inptr)) > 0)
+	{
+		WriteMemoryMap(vNameEnd);
+	}
+	else if ((vNameEnd = StringCompare("qRcmd,", inptr)) > 0)
+	{
+		CmdMonitor(inptr + vNameEnd);
+	}
 }
 
-// Only support software breakpoints
+/*
+	Parses the target side conditions and commands of a Z0 or Z1 packet:
+	"Z0,addr,kind;Xlen,cond...;cmds:persist,Xlen,cmd..."
+	Slots are set to AGENT_NO_SLOT if there are no conditions or commands.
+*/
+bool ParseBreakpointAgent(short offset, short* condition, short* commands)
+{
+	char* inptr = GetInpacketPtr(0);
+	*condition = AGENT_NO_SLOT;
+	*commands = AGENT_NO_SLOT;
+	if (inptr[offset] == ';' && inptr[offset + 1] == 'X')
+	{
+		offset = AgentParseExpressions(offset + 1, condition);
+	}
+	short cmdsEnd;
+	if (offset > 0 && inptr[offset] == ';' && (cmdsEnd = StringCompare("cmds:", inptr + offset + 1)) > 0)
+	{
+		// Commands are removed when gdb disconnects anyway, so persist is ignored.
+		unsigned int persist;
+		offset = ReadNumber(offset + 1 + cmdsEnd, &persist);
+		offset = (offset > 0 && inptr[offset] == ',') ? AgentParseExpressions(offset + 1, commands) : -1;
+	}
+	if (offset < 0)
+	{
+		AgentFreeSlot(*condition);
+		AgentFreeSlot(*commands);
+		return false;
+	}
+	return true;
+}
+
+/*
+	Supports software breakpoints, and write/access watchpoints that are checked while tracing.
+	Other types are answered with an empty packet, which gdb takes as not supported.
+*/
 void CmdSetBreakpoint(void)
 {
 	unsigned char* addr;
 	unsigned int len;
 	short offset = GetAddressAndLength(3, false, &addr, &len);
 	char *inptr = GetInpacketPtr(1);
-	if (offset > 0 && *inptr == '0')
+	if (offset > 0)
 	{
-		if (InsertMemoryBreakpoint((unsigned short*)addr) == 0)
+		int result;
+		switch (*inptr)
+		{
+		case '0':
+		case '1':
+			{
+				// gdb sends the same breakpoint again when its conditions or commands change.
+				short condition;
+				short commands;
+				result = -1;
+				if (ParseBreakpointAgent(offset, &condition, &commands))
+				{
+					result = InsertMemoryBreakpoint((unsigned short*)addr, MEMBREAK_GDB);
+					if (result == 0)
+					{
+						SetBreakpointAgent((unsigned short*)addr, condition, commands);
+					}
+					else
+					{
+						AgentFreeSlot(condition);
+						AgentFreeSlot(commands);
+					}
+				}
+			}
+			break;
+		case '2':
+		case '4':
+			result = InsertWatchpoint(addr, len, *inptr - '0');
+			break;
+		default:
+			return;
+		}
+		if (result == 0)
 		{
 			WriteOK();
 		}
@@ -199,16 +291,27 @@ void CmdSetBreakpoint(void)
 	}
 }
 
-// Only support software breakpoints
 void CmdClearBreakpoint(void)
 {
 	unsigned char* addr;
 	unsigned int len;
 	short offset = GetAddressAndLength(3, false, &addr, &len);
 	char *inptr = GetInpacketPtr(1);
-	if (offset > 0 && *inptr == '0')
+	if (offset > 0)
 	{
-		RemoveMemoryBreakpoint((unsigned short*)addr);
+		switch (*inptr)
+		{
+		case '0':
+		case '1':
+			RemoveMemoryBreakpoint((unsigned short*)addr, MEMBREAK_GDB);
+			break;
+		case '2':
+		case '4':
+			RemoveWatchpoint(addr, len, *inptr - '0');
+			break;
+		default:
+			return;
+		}
 		WriteOK();
 	}
 }
@@ -230,14 +333,7 @@ LoopState CmdContinue(bool trace)
 		// Set a new address to continue/step at.
 		er->pc = add;
 	}
-	if (trace)
-	{
-		er->sr |= 0x8000;
-	}
-	else
-	{
-		er->sr &= ~0x8000;
-	}
+	PrepareResume(trace);
 	return CONTINUE_EXECUTION;
 }
 
@@ -336,6 +432,36 @@ LoopState CmdFileOperation(short cmdEnd)
 	return LISTEN_TO_GDB;
 }
 
+/*
+	"vCont;action[:thread][;action[:thread]]...", we only have one thread so the first action is used.
+	Signals given with C and S are ignored, as with c and s.
+*/
+LoopState CmdVCont(short offset)
+{
+	char* inptr = GetInpacketPtr(0);
+	char action = inptr[offset];
+	if (action == 'c' || action == 'C' || action == 's' || action == 'S')
+	{
+		if (inferiorState == NOT_LOADED)
+		{
+			WriteError(1);
+			return LISTEN_TO_GDB;
+		}
+		PrepareResume(action == 's' || action == 'S');
+		return CONTINUE_EXECUTION;
+	}
+	else if (action == 't')
+	{
+		// Already stopped.
+		WriteOK();
+	}
+	else
+	{
+		WriteError(1);
+	}
+	return LISTEN_TO_GDB;
+}
+
 LoopState CmdFlexible(void)
 {
 	short vNameEnd;
@@ -368,6 +494,24 @@ LoopState CmdFlexible(void)
 	{
 		return CmdFileOperation(vNameEnd);
 	}
+	else if (StringCompare("vCont?",  inptr) > 0)
+	{
+		WriteString("vCont;c;C;s;S;t");
+	}
+	else if ((vNameEnd = StringCompare("vCont;",  inptr)) > 0)
+	{
+		return CmdVCont(vNameEnd);
+	}
+	else if (StringCompare("vStopped",  inptr) > 0)
+	{
+		// There is only one thread, and its stop was sent in the notification.
+		WriteOK();
+	}
+	else if (StringCompare("vCtrlC",  inptr) > 0)
+	{
+		// Already stopped.
+		WriteOK();
+	}
 	return LISTEN_TO_GDB;
 }
 
@@ -466,8 +610,19 @@ LoopState HandleBreakResponse(int si_signo, int si_code, bool* isSupervisorMode)
 			loopState = KILL;
 		}
 		// Write stop packet to gdb.
-		SendStopCode(si_signo, si_code);
-		TransmitPacket(false);
+		if (nonStopMode)
+		{
+			// gdb answers with vStopped. 'O' packets are not allowed here, so output waits for "monitor flush".
+			SendStopCode(si_signo, si_code);
+			TransmitNotification("Stop:");
+		}
+		else
+		{
+			// Output from dprintf goes before the stop packet.
+			ConsoleFlush();
+			SendStopCode(si_signo, si_code);
+			TransmitPacket(false);
+		}
 	}
 	return loopState;
 }
@@ -515,7 +670,7 @@ void HandleCommandLoopExit(LoopState loopState, int si_signo, bool* isSupervisor
 				// Inferior terminated itself.
 				SetServerContext();
 				// Report process exit and inferior return code to gdb.
-				ClearOutPacket();
+				ConsoleFlush();
 				WriteChar('W');
 				WriteByte((unsigned char)return_code);
 				TransmitPacket(true);	// We don't expect any answer.
@@ -559,6 +714,86 @@ void HandleCommandLoopExit(LoopState loopState, int si_signo, bool* isSupervisor
 	}
 }
 
+/*
+	In non-stop mode the start of a packet breaks into the server like CTRL-C does, and the
+	packet is handled here while the inferior is still considered running.
+	Only packets that make sense for a running inferior are handled, like reading memory.
+	Returns false if the inferior must stop, si_signo is then the signal to report.
+*/
+bool NonStopPacket(int* si_signo)
+{
+	if (!nonStopMode || !PacketBreakReceived())
+	{
+		return false;
+	}
+	ClearOutPacket();
+	ReceiveStartedPacket();
+	char* inptr = GetInpacketPtr(0);
+	bool keepRunning = true;
+	switch (inptr[0])
+	{
+	case 'm':	// Read from memory
+		ReadMemory(true);
+		break;
+	case 'M':	// Write to memory
+		WriteMemory(true);
+		break;
+	case 'q':
+	case 'Q':
+		CmdQuery();
+		break;
+	case 'z':
+		CmdClearBreakpoint();
+		break;
+	case 'Z':
+		CmdSetBreakpoint();
+		break;
+	case '?':
+		// No stopped threads.
+		WriteOK();
+		break;
+	case 'v':
+		if (StringCompare("vCtrlC", inptr) > 0)
+		{
+			*si_signo = GDB_SIGINT;
+			keepRunning = false;
+		}
+		else if (StringCompare("vCont;t", inptr) > 0)
+		{
+			*si_signo = 0;
+			keepRunning = false;
+		}
+		else if (StringCompare("vCont?", inptr) > 0)
+		{
+			WriteString("vCont;c;C;s;S;t");
+		}
+		else if (StringCompare("vStopped", inptr) > 0 || StringCompare("vCont;c", inptr) > 0)
+		{
+			WriteOK();
+		}
+		else
+		{
+			WriteError(1);
+		}
+		if (!keepRunning)
+		{
+			// The stop itself is reported with a notification.
+			WriteOK();
+		}
+		break;
+	default:
+		// Needs a stopped inferior.
+		WriteError(1);
+		break;
+	}
+	TransmitPacket(false);
+	if (keepRunning)
+	{
+		comDev->EnableCtrlC(true);
+	}
+	return keepRunning;
+}
+
 void ServerCommandLoop(int si_signo, int si_code)
 {
 	/*
@@ -570,6 +805,9 @@ void ServerCommandLoop(int si_signo, int si_code)
 	DbgOutVal("si_signo", (unsigned int)si_signo);
 	DbgOutVal("si_code", (unsigned int)si_code);
 
+	// Registers may have changed since last time we were here.
+	InvalidateRegisterCache();
+
 	ClearOutPacket();
 	bool isSupervisorMode = false;
 	LoopState loopState = HandleBreakResponse(si_signo, si_code, &isSupervisorMode);
@@ -630,19 +868,40 @@ void ServerCommandLoop(int si_signo, int si_code)
 			loopState = CmdReportStopReason(si_signo, si_code, &skipAck);
 			break;
 		case 'g':	// Get register values
-			ReadRegisters();
+			if (TraceFrameSelected())
+			{
+				TraceReadRegisters();
+			}
+			else
+			{
+				ReadRegisters();
+			}
 			break;
 		case 'G':	// Set register values
 			WriteRegisters();
 			break;
 		case 'm':	// Read from memory
-			ReadMemory(isSupervisorMode);
+			if (TraceFrameSelected())
+			{
+				TraceReadMemory();
+			}
+			else
+			{
+				ReadMemory(isSupervisorMode);
+			}
 			break;
 		case 'M':	// Write to memory
 			WriteMemory(isSupervisorMode);
 			break;
 		case 'p':	// Get specific register
-			ReadRegister();
+			if (TraceFrameSelected())
+			{
+				TraceReadRegister();
+			}
+			else
+			{
+				ReadRegister();
+			}
 			break;
 		case 'P':	// Set specific register
 			WriteRegister();
@@ -672,10 +931,17 @@ void ServerCommandLoop(int si_signo, int si_code)
 			DbgRemOut("\tNot supported, ignoring...\r\n");
 			break;
 		}
+		PacketTraceHandled();
 		if (loopState == LISTEN_TO_GDB)
 		{
 			TransmitPacket(skipAck);
 		}
+		else if (loopState == CONTINUE_EXECUTION && nonStopMode && inferiorState == RUNNING)
+		{
+			// In non-stop mode resuming is answered at once, and the next stop comes as a notification.
+			WriteOK();
+			TransmitPacket(skipAck);
+		}
 	}
 	
 	HandleCommandLoopExit(loopState, si_signo, &isSupervisorMode);
@@ -690,6 +956,7 @@ int ServerMain(bool loadRequest)
 	int ret = -1;
 	// Get cookies
 	Supexec(GetCookies);
+	Supexec(ReadMemoryLayout);
 	if ((Cookie_FPU & (0x1f << 16)) != 0 && Cookie_CPU >= 20)
 	{
 		numOfCpuRegisters = 29;
@@ -723,11 +990,7 @@ int ServerMain(bool loadRequest)
 	{
 		if (loadInferiorRequested)
 		{
-			// Load inferior
-			/*
-				If inferior is an empty file, strange things happen...
-				Need some better fail safe here.
-			*/
+			// Load inferior. Empty and broken files are refused by the header check.
 			if (LoadInferior(inferior_filename, inferior_cmdline, NULL) < 0)
 			{
 				DbgOut("Could not load inferior: ");
@@ -748,7 +1011,12 @@ int ServerMain(bool loadRequest)
 			loadInferiorRequested = false;
 		}
 		ServerCommandLoop(GDB_SIGUSR1, userCodeForCommandLoop);
+		TraceDiscard();
 		DiscardAllBreakpoints();
+		nonStopMode = false;
+		EnablePacketBreak(false);
+		LiveSampleDiscard();
+		TimeDiscard();
 		ret = 0;
 	} while ((extendedMode && !run_once) || option_multi);
 
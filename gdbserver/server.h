@@ -22,6 +22,8 @@ extern bool run_once;
 
 int ServerMain(bool loadRequest);
 void ServerCommandLoop(int si_signo, int si_code);
+// Handles a packet received while the inferior runs in non-stop mode. Returns true if it keeps running.
+bool NonStopPacket(int* si_signo);
 
 // Helper macros for debugging pursposes
 #define BREAKPOINT_OP asm ("trap #0");
@@ -0,0 +1,164 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+#include <stdbool.h>
+#include "timing.h"
+#include "exceptions.h"
+#include "context.h"
+#include "bios_calls.h"
+
+/*
+	Timer B counts down from 256 and its interrupt, only installed in the inferior context,
+	counts the wraps. The hits are handled with interrupts off, so a wrap may be pending.
+	Times include the cost of the breakpoint exceptions, which can be measured by timing
+	two instructions next to each other.
+*/
+#define MFP_TIMER_B_CHANNEL	8
+#define MFP_TBCR			((volatile unsigned char*)0xfffffa1b)
+#define MFP_TBDR			((volatile unsigned char*)0xfffffa21)
+#define MFP_IPRA			((volatile unsigned char*)0xfffffa0b)
+#define MFP_TIMER_B_DIV4	1
+
+void TimeTimer(void);
+
+volatile unsigned int timeWraps;	// Incremented by TimeTimer.
+
+bool timeActive = false;
+unsigned short* timeFrom;
+unsigned short* timeTo;
+unsigned int timePassesLeft;		// 0 for no limit.
+bool timeStarted = false;			// timeFrom have been hit, waiting for timeTo.
+unsigned int timeStart;
+
+unsigned int timePasses = 0;
+unsigned int timeMin;
+unsigned int timeMax;
+unsigned int timeTotal;
+
+unsigned int TimeNow(void)
+{
+	unsigned int wraps = timeWraps;
+	unsigned char count = *MFP_TBDR;
+	if ((*MFP_IPRA & 0x01) != 0)
+	{
+		// Wrapped, but the interrupt haven't been taken yet.
+		++wraps;
+		count = *MFP_TBDR;
+	}
+	return (wraps << 8) + (unsigned char)(0 - count);
+}
+
+bool TimeStart(unsigned short* from, unsigned short* to, unsigned int passes)
+{
+	TimeStop();
+	if (!ClaimInferiorMfpInterrupt(MFP_TIMER_B_CHANNEL, TimeTimer))
+	{
+		return false;
+	}
+	if (InsertMemoryBreakpoint(from, MEMBREAK_TIME) != 0 ||
+		InsertMemoryBreakpoint(to, MEMBREAK_TIME) != 0)
+	{
+		RemoveMemoryBreakpoint(from, MEMBREAK_TIME);
+		ReleaseInferiorMfpInterrupt(MFP_TIMER_B_CHANNEL, TimeTimer);
+		return false;
+	}
+	timeFrom = from;
+	timeTo = to;
+	timePassesLeft = passes;
+	timeStarted = false;
+	timePasses = 0;
+	timeMin = 0xffffffff;
+	timeMax = 0;
+	timeTotal = 0;
+	timeWraps = 0;
+	*MFP_TBCR = 0;
+	*MFP_TBDR = 0;		// 256
+	*MFP_TBCR = MFP_TIMER_B_DIV4;
+	timeActive = true;
+	return true;
+}
+
+void TimeStop(void)
+{
+	if (timeActive)
+	{
+		timeActive = false;
+		timeStarted = false;
+		*MFP_TBCR = 0;
+		RemoveMemoryBreakpoint(timeFrom, MEMBREAK_TIME);
+		RemoveMemoryBreakpoint(timeTo, MEMBREAK_TIME);
+		ReleaseInferiorMfpInterrupt(MFP_TIMER_B_CHANNEL, TimeTimer);
+	}
+}
+
+int TimeDiscard_super(void)
+{
+	*MFP_TBCR = 0;
+	return 0;
+}
+
+void TimeDiscard(void)
+{
+	if (timeActive)
+	{
+		timeActive = false;
+		timeStarted = false;
+		Supexec(TimeDiscard_super);
+	}
+}
+
+void TimeHit(unsigned short* addr)
+{
+	unsigned int now = TimeNow();
+	if (timeStarted && addr == timeTo)
+	{
+		unsigned int t = now - timeStart;
+		timeStarted = false;
+		++timePasses;
+		timeTotal += t;
+		if (t < timeMin)
+		{
+			timeMin = t;
+		}
+		if (t > timeMax)
+		{
+			timeMax = t;
+		}
+		if (timePassesLeft != 0 && --timePassesLeft == 0)
+		{
+			TimeStop();
+			return;
+		}
+	}
+	if (addr == timeFrom)
+	{
+		timeStarted = true;
+		// Started last, so the time taken by the hit itself counts as little as possible.
+		timeStart = TimeNow();
+	}
+}
+
+void TimeAbortPass(void)
+{
+	timeStarted = false;
+}
+
+bool TimeResult(unsigned int* passes, unsigned int* min, unsigned int* avg, unsigned int* max)
+{
+	*passes = timePasses;
+	if (timePasses == 0)
+	{
+		return false;
+	}
+	*min = timeMin;
+	*avg = timeTotal / timePasses;
+	*max = timeMax;
+	return true;
+}
+
+bool TimeActive(void)
+{
+	return timeActive;
+}
@@ -0,0 +1,48 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+/*
+	Timing between two addresses, measured on the target with "monitor time".
+	Two breakpoints owned by MEMBREAK_TIME start and stop MFP timer B based time, and the
+	inferior continues without stopping. Min, average and max are kept over the passes.
+*/
+#ifndef TIMING_DEFINED
+#define TIMING_DEFINED
+
+#include <stdbool.h>
+
+// Timer B runs with the /4 prescaler from the 2.4576 MHz MFP clock.
+#define TIME_TICK_RATE		614400
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+	Plants the breakpoints and claims timer B. from and to may be the same address, every hit
+	then ends one pass and starts the next. Timing stops by itself after passes hits, unless 0.
+	Returns false if the breakpoints can't be inserted or the inferior uses timer B.
+	The inferior must be stopped.
+*/
+bool TimeStart(unsigned short* from, unsigned short* to, unsigned int passes);
+// Removes the breakpoints and stops the timer. The result is kept.
+void TimeStop(void);
+// Forgets everything without touching inferior memory, as the inferior is gone. User mode.
+void TimeDiscard(void);
+
+// Called from the breakpoint exception when a time owned breakpoint is hit.
+void TimeHit(unsigned short* addr);
+// The inferior stopped, so a pass that have started can't be trusted.
+void TimeAbortPass(void);
+
+// Timer ticks. Returns false if there is no finished pass.
+bool TimeResult(unsigned int* passes, unsigned int* min, unsigned int* avg, unsigned int* max);
+bool TimeActive(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TIMING_DEFINED
@@ -0,0 +1,847 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+#include <stdbool.h>
+#include "tracepoint.h"
+#include "exceptions.h"
+#include "critical.h"
+#include "context.h"
+#include "packet.h"
+#include "agent.h"
+#include "clib.h"
+
+/*
+	Tracepoints are breakpoints owned by MEMBREAK_TRACE. When one is hit, the collected
+	registers and memory are stored as a frame in the trace buffer, and the inferior
+	continues without stopping. gdb reads the frames back with QTFrame after tracing.
+	Frames are stored back to back, starting with a TraceFrameHeader followed by blocks:
+	'R' and all cpu registers (no fpu registers).
+	'M', address, length and the memory, padded to an even length.
+	While-stepping actions are not supported, and are ignored.
+*/
+#define NUM_TRACEPOINTS			16
+#define NUM_TRACE_MEMORY		4		// Max number of memory ranges collected by a tracepoint.
+#define NUM_TRACE_VARIABLES		16
+#define TRACE_BUFFER_SIZE		4096
+#define TRACE_REGISTER_LONGS	18
+
+#define ABSOLUTE_ADDRESS		0xffffffff	// Base register for memory ranges that isn't register relative.
+
+typedef struct
+{
+	unsigned int	basereg;
+	unsigned int	offset;
+	unsigned int	len;
+} TraceMemory;
+
+typedef struct
+{
+	unsigned int	number;			// gdb tracepoint number, 0 if unused.
+	unsigned short*	addr;
+	bool			enabled;
+	bool			collectRegisters;
+	unsigned int	passCount;		// Stop tracing after this many hits, 0 for never.
+	unsigned int	hits;
+	short			condition;		// Agent slots, or AGENT_NO_SLOT.
+	short			expressions;
+	short			numMemory;
+	TraceMemory		memory[NUM_TRACE_MEMORY];
+} TracePoint;
+
+typedef struct
+{
+	unsigned short	num;			// 0 if unused.
+	unsigned int	value;
+} TraceVariable;
+
+typedef struct
+{
+	unsigned short	tpnum;
+	unsigned short	size;			// Including the header.
+	unsigned int	addr;
+} TraceFrameHeader;
+
+typedef enum
+{
+	TRACE_RUNNING,
+	TRACE_NOT_RUN,
+	TRACE_STOPPED,
+	TRACE_FULL,
+	TRACE_PASSCOUNT
+} TraceStopReason;
+
+TracePoint tracepoints[NUM_TRACEPOINTS];
+TraceVariable traceVariables[NUM_TRACE_VARIABLES];
+unsigned char traceBuffer[TRACE_BUFFER_SIZE] __attribute__((aligned(2)));
+unsigned short traceUsed = 0;			// Bytes used in traceBuffer.
+unsigned short traceFrames = 0;
+bool traceOverflow = false;				// The frame being collected didn't fit.
+bool traceCollecting = false;			// Collecting a frame, the agent trace bytecodes are allowed.
+bool tracing = false;
+TraceStopReason traceStopReason = TRACE_NOT_RUN;
+unsigned int traceStopTracepoint = 0;
+short selectedFrame = -1;				// Frame number selected with QTFrame, or -1.
+TraceFrameHeader* selectedHeader = 0;
+
+TracePoint* FindTracepoint(unsigned int number, unsigned int addr)
+{
+	for (short i = 0; i < NUM_TRACEPOINTS; ++i)
+	{
+		TracePoint* tp = &tracepoints[i];
+		if (tp->number == number && (unsigned int)tp->addr == addr)
+		{
+			return tp;
+		}
+	}
+	return 0;
+}
+
+void FreeTracepoint(TracePoint* tp)
+{
+	AgentFreeSlot(tp->condition);
+	AgentFreeSlot(tp->expressions);
+	tp->condition = AGENT_NO_SLOT;
+	tp->expressions = AGENT_NO_SLOT;
+	// Free slots are found with FindTracepoint(0, 0).
+	tp->number = 0;
+	tp->addr = 0;
+}
+
+void StopTracing(TraceStopReason reason, unsigned int tpnum)
+{
+	if (tracing)
+	{
+		tracing = false;
+		for (short i = 0; i < NUM_TRACEPOINTS; ++i)
+		{
+			TracePoint* tp = &tracepoints[i];
+			if (tp->number != 0 && tp->enabled)
+			{
+				RemoveMemoryBreakpoint(tp->addr, MEMBREAK_TRACE);
+			}
+		}
+		traceStopReason = reason;
+		traceStopTracepoint = tpnum;
+	}
+}
+
+bool StartTracing(void)
+{
+	StopTracing(TRACE_STOPPED, 0);
+	traceUsed = 0;
+	traceFrames = 0;
+	traceOverflow = false;
+	selectedFrame = -1;
+	tracing = true;
+	for (short i = 0; i < NUM_TRACEPOINTS; ++i)
+	{
+		TracePoint* tp = &tracepoints[i];
+		tp->hits = 0;
+		if (tp->number != 0 && tp->enabled && InsertMemoryBreakpoint(tp->addr, MEMBREAK_TRACE) != 0)
+		{
+			// Removes the traps inserted so far.
+			StopTracing(TRACE_STOPPED, 0);
+			return false;
+		}
+	}
+	return true;
+}
+
+void TraceDiscard(void)
+{
+	// The breakpoints are discarded together with all other breakpoints.
+	tracing = false;
+	for (short i = 0; i < NUM_TRACEPOINTS; ++i)
+	{
+		tracepoints[i].number = 0;
+		tracepoints[i].addr = 0;
+		tracepoints[i].condition = AGENT_NO_SLOT;
+		tracepoints[i].expressions = AGENT_NO_SLOT;
+	}
+	for (short i = 0; i < NUM_TRACE_VARIABLES; ++i)
+	{
+		traceVariables[i].num = 0;
+	}
+	traceUsed = 0;
+	traceFrames = 0;
+	traceStopReason = TRACE_NOT_RUN;
+	selectedFrame = -1;
+}
+
+TraceVariable* FindVariable(unsigned short num)
+{
+	for (short i = 0; i < NUM_TRACE_VARIABLES; ++i)
+	{
+		if (traceVariables[i].num == num)
+		{
+			return &traceVariables[i];
+		}
+	}
+	return 0;
+}
+
+bool TraceGetVariable(unsigned short num, unsigned int* value)
+{
+	TraceVariable* tv = num != 0 ? FindVariable(num) : 0;
+	if (tv == 0)
+	{
+		return false;
+	}
+	*value = tv->value;
+	return true;
+}
+
+bool TraceSetVariable(unsigned short num, unsigned int value)
+{
+	TraceVariable* tv = num != 0 ? FindVariable(num) : 0;
+	if (tv == 0)
+	{
+		return false;
+	}
+	tv->value = value;
+	return true;
+}
+
+/*
+	Frame collection.
+*/
+
+unsigned char* TraceReserve(unsigned int size)
+{
+	if (traceOverflow || size > (unsigned int)(TRACE_BUFFER_SIZE - traceUsed))
+	{
+		traceOverflow = true;
+		return 0;
+	}
+	unsigned char* ptr = traceBuffer + traceUsed;
+	traceUsed += (unsigned short)size;
+	return ptr;
+}
+
+bool TraceCollectMemory(unsigned int addr, unsigned int len)
+{
+	if (!traceCollecting)
+	{
+		return false;
+	}
+	unsigned char* ptr = len <= 0xffff ? TraceReserve(8 + ((len + 1) & ~1)) : 0;
+	if (ptr != 0)
+	{
+		ptr[0] = 'M';
+		ptr[1] = 0;
+		*(unsigned int*)(ptr + 2) = addr;
+		unsigned int i = 0;
+		for (; i < len; ++i)
+		{
+			if (ExceptionSafeMemoryRead(InferiorContextMemoryAddress((unsigned char*)(addr + i)), ptr + 8 + i) != 0)
+			{
+				// Only keep what could be read.
+				traceUsed = (unsigned short)((ptr + 8 + ((i + 1) & ~1)) - traceBuffer);
+				break;
+			}
+		}
+		*(unsigned short*)(ptr + 6) = (unsigned short)i;
+	}
+	else
+	{
+		traceOverflow = true;
+	}
+	return true;
+}
+
+void CollectFrame(TracePoint* tp)
+{
+	unsigned short frameStart = traceUsed;
+	traceCollecting = true;
+	TraceFrameHeader* header = (TraceFrameHeader*)TraceReserve(sizeof(TraceFrameHeader));
+	if (header != 0)
+	{
+		header->tpnum = (unsigned short)tp->number;
+		header->addr = (unsigned int)tp->addr;
+	}
+	unsigned int* regs = (unsigned int*)GetRegisters();
+	if (tp->collectRegisters)
+	{
+		unsigned char* ptr = TraceReserve(2 + TRACE_REGISTER_LONGS * 4);
+		if (ptr != 0)
+		{
+			ptr[0] = 'R';
+			ptr[1] = 0;
+			unsigned int* dst = (unsigned int*)(ptr + 2);
+			for (short i = 0; i < TRACE_REGISTER_LONGS; ++i)
+			{
+				dst[i] = regs[i];
+			}
+		}
+	}
+	for (short i = 0; i < tp->numMemory; ++i)
+	{
+		TraceMemory* tm = &tp->memory[i];
+		unsigned int base = 0;
+		if (tm->basereg != ABSOLUTE_ADDRESS)
+		{
+			if (tm->basereg >= TRACE_REGISTER_LONGS)
+			{
+				continue;
+			}
+			base = regs[tm->basereg];
+		}
+		TraceCollectMemory(base + tm->offset, tm->len);
+	}
+	if (tp->expressions != AGENT_NO_SLOT)
+	{
+		AgentRunCommands(tp->expressions);
+	}
+	traceCollecting = false;
+	if (traceOverflow)
+	{
+		// Drop the partial frame.
+		traceUsed = frameStart;
+		StopTracing(TRACE_FULL, 0);
+		return;
+	}
+	header->size = traceUsed - frameStart;
+	++traceFrames;
+}
+
+void TraceHit(unsigned short* addr)
+{
+	for (short i = 0; i < NUM_TRACEPOINTS && tracing; ++i)
+	{
+		TracePoint* tp = &tracepoints[i];
+		if (tp->number == 0 || !tp->enabled || tp->addr != addr || !AgentConditionTrue(tp->condition))
+		{
+			continue;
+		}
+		++tp->hits;
+		CollectFrame(tp);
+		if (tracing && tp->passCount != 0 && tp->hits >= tp->passCount)
+		{
+			StopTracing(TRACE_PASSCOUNT, tp->number);
+		}
+	}
+}
+
+/*
+	Reading from a selected frame.
+*/
+
+bool TraceFrameSelected(void)
+{
+	return selectedFrame >= 0;
+}
+
+// Returns the first block of type in the selected frame, or 0.
+unsigned char* FindBlock(char type, unsigned char* from)
+{
+	unsigned char* end = (unsigned char*)selectedHeader + selectedHeader->size;
+	unsigned char* ptr = from != 0 ? from : (unsigned char*)(selectedHeader + 1);
+	while (ptr < end)
+	{
+		if (ptr[0] == (unsigned char)type)
+		{
+			return ptr;
+		}
+		if (ptr[0] == 'R')
+		{
+			ptr += 2 + TRACE_REGISTER_LONGS * 4;
+		}
+		else
+		{
+			ptr += 8 + ((*(unsigned short*)(ptr + 6) + 1) & ~1);
+		}
+	}
+	return 0;
+}
+
+void WriteFrameLong(unsigned char* regBlock, short idx)
+{
+	if (regBlock != 0 && idx < TRACE_REGISTER_LONGS)
+	{
+		WriteLong(((unsigned int*)(regBlock + 2))[idx]);
+	}
+	else if (idx == 17)
+	{
+		// pc is always known.
+		WriteLong(selectedHeader->addr);
+	}
+	else
+	{
+		WriteString("xxxxxxxx");
+	}
+}
+
+void TraceReadRegisters(void)
+{
+	unsigned char* regBlock = FindBlock('R', 0);
+	short num = GetNumRegisterLongs();
+	for (short i = 0; i < num; ++i)
+	{
+		WriteFrameLong(regBlock, i);
+	}
+}
+
+void TraceReadRegister(void)
+{
+	unsigned int idx;
+	if (ReadNumber(1, &idx) > 0)
+	{
+		unsigned char* regBlock = FindBlock('R', 0);
+		short count;
+		short first = RegisterLongs(idx, &count);
+		for (short i = 0; i < count; ++i)
+		{
+			WriteFrameLong(regBlock, first + i);
+		}
+	}
+}
+
+void TraceReadMemory(void)
+{
+	unsigned char* addr;
+	unsigned int len;
+	if (GetAddressAndLength(1, false, &addr, &len) > 0)
+	{
+		unsigned int a = (unsigned int)addr;
+		unsigned int written = 0;
+		unsigned char* block = FindBlock('M', 0);
+		while (block != 0 && written < len)
+		{
+			unsigned int start = *(unsigned int*)(block + 2);
+			unsigned int size = *(unsigned short*)(block + 6);
+			if (a >= start && a < start + size)
+			{
+				// Continue from the start, as ranges may be collected in any order.
+				for (; a < start + size && written < len; ++a, ++written)
+				{
+					WriteByte(block[8 + (a - start)]);
+				}
+				block = FindBlock('M', 0);
+			}
+			else
+			{
+				block = FindBlock('M', block + 8 + ((size + 1) & ~1));
+			}
+		}
+		if (written != 0)
+		{
+			return;
+		}
+	}
+	WriteError(1);
+}
+
+/*
+	Packets.
+*/
+
+// Reads a number followed by ':', returns the offset after ':' or -1.
+short ReadField(short offset, unsigned int* value)
+{
+	char* inptr = GetInpacketPtr(0);
+	offset = offset > 0 ? ReadNumber(offset, value) : -1;
+	return (offset > 0 && inptr[offset] == ':') ? offset + 1 : -1;
+}
+
+/*
+	"QTDP:n:addr:E|D:step:pass[:Fflen][:Xlen,cond][-]" defines a tracepoint.
+	"QTDP:-n:addr:[S]action[-]" adds actions to it.
+*/
+void CmdDefineTracepoint(short offset)
+{
+	char* inptr = GetInpacketPtr(0);
+	short length = GetInPacketLength();
+	unsigned int number, addr;
+	bool action = inptr[offset] == '-';
+	if (action)
+	{
+		++offset;
+	}
+	offset = ReadField(offset, &number);
+	if (offset < 0 || (offset = ReadNumber(offset, &addr)) < 0 || number == 0)
+	{
+		WriteError(1);
+		return;
+	}
+	TracePoint* tp = FindTracepoint(number, addr);
+	if (!action)
+	{
+		unsigned int step, pass;
+		if (tracing || inptr[offset] != ':' || inptr[offset + 2] != ':')
+		{
+			WriteError(1);
+			return;
+		}
+		bool enabled = inptr[offset + 1] == 'E';
+		// A step count for while-stepping is accepted, but no stepping frames are collected.
+		if ((offset = ReadField(offset + 3, &step)) < 0 || (offset = ReadNumber(offset, &pass)) < 0)
+		{
+			WriteError(1);
+			return;
+		}
+		if (tp == 0)
+		{
+			tp = FindTracepoint(0, 0);
+		}
+		else
+		{
+			FreeTracepoint(tp);
+		}
+		if (tp == 0)
+		{
+			WriteError(1);
+			return;
+		}
+		tp->number = number;
+		tp->addr = (unsigned short*)addr;
+		tp->enabled = enabled;
+		tp->passCount = pass;
+		tp->hits = 0;
+		tp->collectRegisters = false;
+		tp->numMemory = 0;
+		tp->condition = AGENT_NO_SLOT;
+		tp->expressions = AGENT_NO_SLOT;
+		while (offset > 0 && offset < length && inptr[offset] == ':')
+		{
+			++offset;
+			if (inptr[offset] == 'X')
+			{
+				offset = AgentParseExpressions(offset, &tp->condition);
+			}
+			else
+			{
+				// Fast and static tracepoints are not supported, skip the field.
+				while (offset < length && inptr[offset] != ':' && inptr[offset] != '-')
+				{
+					++offset;
+				}
+			}
+		}
+		if (offset < 0)
+		{
+			FreeTracepoint(tp);
+			WriteError(1);
+			return;
+		}
+	}
+	else
+	{
+		if (tp == 0 || inptr[offset] != ':')
+		{
+			WriteError(1);
+			return;
+		}
+		++offset;
+		if (inptr[offset] == 'S')
+		{
+			// While-stepping actions are not supported.
+			WriteOK();
+			return;
+		}
+		while (offset > 0 && offset < length && inptr[offset] != '-')
+		{
+			char type = inptr[offset++];
+			if (type == 'R')
+			{
+				// Any register asked for collects them all.
+				for (; offset < length && inptr[offset] != '-' && inptr[offset] != 'M' && inptr[offset] != 'X'; ++offset)
+				{
+					if (inptr[offset] != '0')
+					{
+						tp->collectRegisters = true;
+					}
+				}
+			}
+			else if (type == 'M' && tp->numMemory < NUM_TRACE_MEMORY)
+			{
+				TraceMemory* tm = &tp->memory[tp->numMemory];
+				offset = ReadNumber(offset, &tm->basereg);
+				offset = (offset > 0 && inptr[offset] == ',') ? ReadNumber(offset + 1, &tm->offset) : -1;
+				offset = (offset > 0 && inptr[offset] == ',') ? ReadNumber(offset + 1, &tm->len) : -1;
+				if (offset > 0)
+				{
+					++tp->numMemory;
+				}
+			}
+			else if (type == 'X')
+			{
+				offset = AgentParseExpressions(offset - 1, &tp->expressions);
+			}
+			else
+			{
+				offset = -1;
+			}
+		}
+		if (offset < 0)
+		{
+			WriteError(1);
+			return;
+		}
+	}
+	WriteOK();
+}
+
+// "QTDV:n:value:builtin:name" defines a trace state variable.
+void CmdDefineVariable(short offset)
+{
+	unsigned int num, value;
+	offset = ReadField(offset, &num);
+	if (offset < 0 || ReadNumber(offset, &value) < 0 || num == 0 || num > 0xffff)
+	{
+		WriteError(1);
+		return;
+	}
+	TraceVariable* tv = FindVariable((unsigned short)num);
+	if (tv == 0)
+	{
+		tv = FindVariable(0);
+	}
+	if (tv == 0)
+	{
+		WriteError(1);
+		return;
+	}
+	tv->num = (unsigned short)num;
+	tv->value = value;
+	WriteOK();
+}
+
+void CmdTraceStatus(void)
+{
+	WriteString(tracing ? "T1" : "T0");
+	switch (tracing ? TRACE_RUNNING : traceStopReason)
+	{
+	case TRACE_RUNNING:
+		break;
+	case TRACE_NOT_RUN:
+		WriteString(";tnotrun:0");
+		break;
+	case TRACE_STOPPED:
+		WriteString(";tstop:0");
+		break;
+	case TRACE_FULL:
+		WriteString(";tfull:0");
+		break;
+	case TRACE_PASSCOUNT:
+		WriteString(";tpasscount:");
+		WriteLong(traceStopTracepoint);
+		break;
+	}
+	WriteString(";tframes:");
+	WriteLong(traceFrames);
+	WriteString(";tcreated:");
+	WriteLong(traceFrames);
+	WriteString(";tfree:");
+	WriteLong(TRACE_BUFFER_SIZE - traceUsed);
+	WriteString(";tsize:");
+	WriteLong(TRACE_BUFFER_SIZE);
+	WriteString(";circular:0;disconn:0");
+}
+
+/*
+	"QTFrame:n", "QTFrame:pc:addr", "QTFrame:tdp:t", "QTFrame:range:start:end" and
+	"QTFrame:outside:start:end" selects a frame. All but the first searches forward from
+	the frame after the selected one.
+*/
+void CmdSelectFrame(short offset)
+{
+	char* inptr = GetInpacketPtr(0);
+	short mode;
+	unsigned int a = 0, b = 0;
+	short first = selectedFrame + 1;
+	short end;
+	if ((end = StringCompare("pc:", inptr + offset)) > 0)
+	{
+		mode = 1;
+		offset = ReadNumber(offset + end, &a);
+	}
+	else if ((end = StringCompare("tdp:", inptr + offset)) > 0)
+	{
+		mode = 2;
+		offset = ReadNumber(offset + end, &a);
+	}
+	else if ((end = StringCompare("range:", inptr + offset)) > 0)
+	{
+		mode = 3;
+		offset = ReadField(offset + end, &a);
+		offset = offset > 0 ? ReadNumber(offset, &b) : -1;
+	}
+	else if ((end = StringCompare("outside:", inptr + offset)) > 0)
+	{
+		mode = 4;
+		offset = ReadField(offset + end, &a);
+		offset = offset > 0 ? ReadNumber(offset, &b) : -1;
+	}
+	else
+	{
+		mode = 0;
+		bool minus = inptr[offset] == '-';
+		offset = ReadNumber(offset, &a);
+		first = 0;
+		// "tfind none" sends -1 as ffffffff.
+		if (minus || (offset > 0 && a == 0xffffffff))
+		{
+			selectedFrame = -1;
+			WriteOK();
+			return;
+		}
+	}
+	if (offset < 0 || tracing)
+	{
+		WriteError(1);
+		return;
+	}
+	unsigned char* ptr = traceBuffer;
+	for (short n = 0; n < (short)traceFrames; ++n)
+	{
+		TraceFrameHeader* header = (TraceFrameHeader*)ptr;
+		ptr += header->size;
+		if (n < first)
+		{
+			continue;
+		}
+		bool found;
+		switch (mode)
+		{
+		case 0:
+			found = (unsigned int)n == a;
+			break;
+		case 1:
+			found = header->addr == a;
+			break;
+		case 2:
+			found = header->tpnum == a;
+			break;
+		case 3:
+			found = header->addr >= a && header->addr <= b;
+			break;
+		default:
+			found = header->addr < a || header->addr > b;
+			break;
+		}
+		if (found)
+		{
+			selectedFrame = n;
+			selectedHeader = header;
+			WriteChar('F');
+			WriteLong((unsigned int)n);
+			WriteChar('T');
+			WriteLong(header->tpnum);
+			return;
+		}
+	}
+	WriteString("F-1");
+}
+
+// "qTP:n:addr" replies with hits and buffer usage of a tracepoint.
+void CmdTracepointStatus(short offset)
+{
+	unsigned int number, addr;
+	offset = ReadField(offset, &number);
+	TracePoint* tp = (offset > 0 && ReadNumber(offset, &addr) > 0) ? FindTracepoint(number, addr) : 0;
+	if (tp == 0 || number == 0)
+	{
+		WriteError(1);
+		return;
+	}
+	WriteChar('V');
+	WriteLong(tp->hits);
+	WriteString(":0");
+}
+
+// "qTV:n" replies with the value of a trace state variable.
+void CmdGetVariable(short offset)
+{
+	unsigned int num, value;
+	if (ReadNumber(offset, &num) < 0 || num > 0xffff || !TraceGetVariable((unsigned short)num, &value))
+	{
+		WriteChar('U');
+		return;
+	}
+	WriteChar('V');
+	if ((int)value < 0)
+	{
+		// gdb values are 64 bit.
+		WriteLong(0xffffffff);
+	}
+	WriteLong(value);
+}
+
+bool CmdTracepoint(void)
+{
+	char* inptr = GetInpacketPtr(0);
+	short end;
+	if (inptr[1] != 'T')
+	{
+		return false;
+	}
+	if (StringCompare("QTinit", inptr) > 0)
+	{
+		StopTracing(TRACE_STOPPED, 0);
+		for (short i = 0; i < NUM_TRACEPOINTS; ++i)
+		{
+			FreeTracepoint(&tracepoints[i]);
+		}
+		TraceDiscard();
+		WriteOK();
+	}
+	else if ((end = StringCompare("QTDP:", inptr)) > 0)
+	{
+		CmdDefineTracepoint(end);
+	}
+	else if ((end = StringCompare("QTDV:", inptr)) > 0)
+	{
+		CmdDefineVariable(end);
+	}
+	else if (StringCompare("QTStart", inptr) > 0)
+	{
+		if (StartTracing())
+		{
+			WriteOK();
+		}
+		else
+		{
+			WriteError(1);
+		}
+	}
+	else if (StringCompare("QTStop", inptr) > 0)
+	{
+		StopTracing(TRACE_STOPPED, 0);
+		WriteOK();
+	}
+	else if (StringCompare("qTStatus", inptr) > 0)
+	{
+		CmdTraceStatus();
+	}
+	else if ((end = StringCompare("QTFrame:", inptr)) > 0)
+	{
+		CmdSelectFrame(end);
+	}
+	else if ((end = StringCompare("qTP:", inptr)) > 0)
+	{
+		CmdTracepointStatus(end);
+	}
+	else if ((end = StringCompare("qTV:", inptr)) > 0)
+	{
+		CmdGetVariable(end);
+	}
+	else if (StringCompare("qTfP", inptr) > 0 || StringCompare("qTsP", inptr) > 0 ||
+		StringCompare("qTfV", inptr) > 0 || StringCompare("qTsV", inptr) > 0)
+	{
+		// Nothing to upload, tracepoints and variables only live while gdb is connected.
+		WriteChar('l');
+	}
+	else if (StringCompare("QTDPsrc:", inptr) > 0 || StringCompare("QTro:", inptr) > 0 ||
+		StringCompare("QTDisconnected:", inptr) > 0 || StringCompare("QTNotes:", inptr) > 0)
+	{
+		// Accepted and ignored.
+		WriteOK();
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
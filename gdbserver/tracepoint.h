@@ -0,0 +1,45 @@
+/*
+	Copyright (C) 2026 Mikael Hildenborg
+	SPDX-License-Identifier: MIT
+*/
+
+/*
+	gdb tracepoints.
+	https://sourceware.org/gdb/current/onlinedocs/gdb.html/Tracepoint-Packets.html
+*/
+#ifndef TRACEPOINT_DEFINED
+#define TRACEPOINT_DEFINED
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Handles all tracepoint packets, QT*, qT*. Returns false if the packet isn't a tracepoint packet.
+bool CmdTracepoint(void);
+
+// Called from the breakpoint exception when a trace owned breakpoint is hit.
+void TraceHit(unsigned short* addr);
+
+// Stops tracing without touching inferior memory, as the inferior is gone.
+void TraceDiscard(void);
+
+// Adds memory to the frame being collected, for the agent trace bytecodes. Returns false if not collecting.
+bool TraceCollectMemory(unsigned int addr, unsigned int len);
+
+// Trace state variables, for the agent getv and setv.
+bool TraceGetVariable(unsigned short num, unsigned int* value);
+bool TraceSetVariable(unsigned short num, unsigned int value);
+
+// When a trace frame is selected, register and memory reads are served from the frame.
+bool TraceFrameSelected(void);
+void TraceReadRegisters(void);
+void TraceReadRegister(void);
+void TraceReadMemory(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRACEPOINT_DEFINED